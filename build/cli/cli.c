@@ -1,5 +1,6 @@
 #include <gensyn/gensyn.h>
 #include <gensyn/gate.h>
+#include <gensyn/render.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,8 +11,11 @@
  *  Can be used to produce synth samples from gensyn using 
  *  ECMA scripting to build / load  / confiugure the synth 
  * 
- *  Using the "@" command, a raw PCM file can be produced
- *  The format can be configured using the values below.
+ *  Using the "@" command, a WAV file can be produced:
+ *
+ *      @file.wav [seconds] [sample rate] [block size]
+ *
+ *  Any values left out use the defaults below.
  * 
  */
 
@@ -24,29 +28,33 @@
 
 
 
-static void write_output_pcm(gensyn_t * g, const char * output) {
-    FILE * f = fopen(output, "wb");
-    if (!f) {
-        printf("Cannot write output waveform to %s\n", output);
+static void write_output_wav(gensyn_t * g, const char * command) {
+    char output[4096];
+    gensyn_render_options_t options;
+    gensyn_render_stats_t stats;
+    gensyn_render_options_init(&options);
+    options.sampleRate = SAMPLERATE;
+    options.blockSize  = BUFFERSIZE;
+    options.duration   = DURATION_SEC;
+
+    if (sscanf(command, "%4095s %lf %f %u", output, &options.duration, &options.sampleRate, &options.blockSize) < 1) {
+        printf("Usage: @file.wav [seconds] [sample rate] [block size]\n");
         return;
     }
-    
-    float    * buffer     = calloc(BUFFERSIZE, sizeof(float));
-
-    uint32_t i, n;
-    for(i = 0; i < SAMPLERATE * DURATION_SEC; i+=BUFFERSIZE) {
-        gensyn_generate_waveform(
-            g,
-            buffer,
-            BUFFERSIZE,
-            SAMPLERATE
-        );
-        
-        fwrite(buffer, BUFFERSIZE, sizeof(float), f);        
+
+    if (!gensyn_render_to_file(g, output, &options, &stats)) {
+        printf("Cannot write output waveform to %s\n", output);
+        return;
     }
-    free(buffer);
-    fclose(f);
-    printf("Wrote waveform (32bit float [-1, 1])to %s\n", output);
+    printf(
+        "Wrote waveform (32bit float WAV, %.0f Hz) to %s\n"
+        "Rendered %.2fs of audio in %.2fs (%.1fx real time)\n",
+        options.sampleRate,
+        output,
+        stats.sampleCount / options.sampleRate,
+        stats.seconds,
+        stats.speed
+    );
 }
 
 
@@ -92,14 +100,14 @@ int main() {
     char buffer[4096];
     while(1) {
         printf("$ "); fflush(stdout);
-        fgets(buffer, 4096, stdin);
+        if (!fgets(buffer, 4096, stdin)) break;
 
 
         // output command
         if (buffer[0] == '@') {
             // remove newline.
             buffer[strlen(buffer)-1] = 0;
-            write_output_pcm(g, buffer+1);
+            write_output_wav(g, buffer+1);
         } else {
             
             printf("%s\n", 
@@ -109,4 +117,5 @@ int main() {
             );
         }
     }
+    return 0;
 }
@@ -0,0 +1,246 @@
+#include <gensyn/gensyn.h>
+#include <gensyn/gate.h>
+#include <gensyn/system.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+
+// Stress test for editing the circuit while audio is running.
+// A probe gate on the first channel checks every block that its IN
+// is connected and holds 1. Its IN is swapped between two gates by
+// disconnecting and connecting again, with a wait in between, so any
+// half-applied edit that reaches the audio thread is caught. Meanwhile,
+// gates are created, connected and removed on the second channel
+// through commands, including Voices gates and gates that read input,
+// and the worker count is changed. Lastly, more gates that read input
+// are removed at once than the input thread's queue holds, which must
+// all be freed once nothing can be using them.
+//
+// Usage: live-test [device] [seconds]
+// The device defaults to "null", which needs no sound card.
+// Best built with -fsanitize=address to catch gates freed too early.
+
+
+#define SWAP_WAIT_US   1000
+#define EDIT_WAIT_US   200
+#define CHURN_GATES    8
+#define MASS_REMOVE    1500
+
+
+static atomic_long goodBlocks;
+static atomic_long badBlocks;
+static atomic_long readersCreated;
+static atomic_long readersRemoved;
+
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static void sleep_us(long us) {
+    struct timespec t;
+    t.tv_sec = us / 1000000;
+    t.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&t, NULL);
+}
+
+
+
+
+static void * probe__on_create(gensyn_gate_t * g) {
+    return NULL;
+}
+
+static int probe__on_update(
+    gensyn_gate_t *     gate,
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    float value;
+    if (inSampleBuffers[0] && gensyn_gate_get_in_constant(gate, 0, &value) && value == 1.f) {
+        atomic_fetch_add(&goodBlocks, 1);
+    } else {
+        atomic_fetch_add(&badBlocks, 1);
+    }
+    return 0;
+}
+
+static void probe__on_remove(gensyn_gate_t * g, void * userData) {
+}
+
+
+
+// reads input, so the input thread holds on to it until told to drop it.
+static void * reader__on_create(gensyn_gate_t * g) {
+    atomic_fetch_add(&readersCreated, 1);
+    return NULL;
+}
+
+static int reader__on_update(
+    gensyn_gate_t *     gate,
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    return 0;
+}
+
+static void reader__on_input(gensyn_gate_t * g, const gensyn_system__input_event_t * event, void * userData) {
+}
+
+static void reader__on_remove(gensyn_gate_t * g, void * userData) {
+    atomic_fetch_add(&readersRemoved, 1);
+}
+
+
+
+
+
+static void churn(gensyn_t * g, double seconds) {
+    gensyn_gate_t * probe = gensyn_get_named_gate(g, GENSYN_STR_CAST("probe"));
+    gensyn_gate_t * a     = gensyn_get_named_gate(g, GENSYN_STR_CAST("a"));
+    gensyn_gate_t * b     = gensyn_get_named_gate(g, GENSYN_STR_CAST("b"));
+    char command[1024];
+    double end = now() + seconds;
+    uint32_t i;
+    for(i = 0; now() < end; ++i) {
+        // only published once the new IN is in place.
+        gensyn_gate_disconnect(NULL, GENSYN_STR_CAST("input"), probe);
+        sleep_us(SWAP_WAIT_US);
+        gensyn_gate_connect(i & 1 ? b : a, GENSYN_STR_CAST("input"), probe);
+        gensyn_publish_circuit(g);
+
+        int k = i % CHURN_GATES;
+        int voices = i % 5 == 0;
+        snprintf(command, sizeof(command),
+            "try { gensyn.gate.get('s%d').remove(); } catch(e) {}"
+            "try { gensyn.gate.get('r%d').remove(); } catch(e) {}"
+            "var s = gensyn.gate.add('%s', 's%d');"
+            "if (%d) s.setTemplate(gensyn.gate.get('templateSine'), 2);"
+            "s.connectTo('input%d', gensyn.gate.get('mix'));"
+            "var r = gensyn.gate.add('Reader', 'r%d');"
+            "r.connectTo('input%d', gensyn.gate.get('mix'));",
+            k, k, voices ? "Voices" : "Sine_Wave", k, voices, k, k, k+CHURN_GATES
+        );
+        gensyn_send_command(g, GENSYN_STR_CAST(command));
+        if (i % 64 == 0) gensyn_set_worker_count(g, (i/64) % 3);
+        sleep_us(EDIT_WAIT_US);
+    }
+    printf("churn: %u edits, %ld blocks checked\n", i, (long)atomic_load(&goodBlocks) + atomic_load(&badBlocks));
+}
+
+
+static void mass_remove(gensyn_t * g) {
+    char command[256];
+    snprintf(command, sizeof(command),
+        "for(var i = 0; i < %d; ++i) gensyn.gate.add('Reader', 'mass' + i);", MASS_REMOVE
+    );
+    gensyn_send_command(g, GENSYN_STR_CAST(command));
+
+    // removed straight from C, faster than the input thread keeps up.
+    long before = atomic_load(&readersRemoved);
+    gensyn_string_t * name = gensyn_string_create();
+    uint32_t i;
+    for(i = 0; i < MASS_REMOVE; ++i) {
+        gensyn_string_clear(name);
+        gensyn_string_concat_printf(name, "mass%d", (int)i);
+        gensyn_destroy_named_gate(g, name);
+    }
+    gensyn_string_destroy(name);
+
+    // the rest are sent and freed as the input thread catches up.
+    double end = now() + 5;
+    while(atomic_load(&readersRemoved) - before < MASS_REMOVE && now() < end) {
+        sleep_us(EDIT_WAIT_US);
+        gensyn_publish_circuit(g);
+    }
+    long removed = atomic_load(&readersRemoved) - before;
+    printf("mass remove: %ld of %d gates freed\n", removed, MASS_REMOVE);
+    if (removed != MASS_REMOVE) {
+        printf("FAILED: removed gates were not freed\n");
+        exit(1);
+    }
+}
+
+
+
+int main(int argc, char ** argv) {
+    const char * device = argc > 1 ? argv[1] : "null";
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+
+    gensyn_create_options_t options;
+    gensyn_create_options_init(&options);
+    options.probeDevices = 0;
+    options.channels = 2;
+    gensyn_t * g = gensyn_create_with_options(&options);
+
+    gensyn_gate_register(
+        g, GENSYN_STR_CAST("Probe"), GENSYN_STR_CAST("Checks that its IN is always 1."), 1,
+        probe__on_create, probe__on_update, probe__on_remove, NULL,
+        GENSYN_GATE__PROPERTY__CONNECTION, GENSYN_STR_CAST("input"),
+        GENSYN_GATE__PROPERTY__END
+    );
+    gensyn_gate_register(
+        g, GENSYN_STR_CAST("Reader"), GENSYN_STR_CAST("Reads input and outputs nothing."), 1,
+        reader__on_create, reader__on_update, reader__on_remove, reader__on_input,
+        GENSYN_GATE__PROPERTY__END
+    );
+
+    gensyn_send_command(g, GENSYN_STR_CAST(
+        "var a = gensyn.gate.add('Simple_Input', 'a'); a.setParam('value', 1);"
+        "var b = gensyn.gate.add('Simple_Input', 'b'); b.setParam('value', 1);"
+        "var probe = gensyn.gate.add('Probe', 'probe'); a.connectTo('input', probe);"
+        "probe.connectTo('waveform', gensyn.gate.get('output'));"
+        "var mix = gensyn.gate.add('Mixer', 'mix');"
+        "mix.connectTo('waveform', gensyn.gate.get('output1'));"
+        "var sine = gensyn.gate.add('Sine_Wave', 'templateSine');"
+        "gensyn.gate.add('Simple_Input', 'templatePitch').connectTo('pitch', sine);"
+    ));
+
+    gensyn_system_audio_options_t audio;
+    gensyn_system_audio_options_init(&audio);
+    audio.device = device;
+    audio.periodSize = 64;
+    audio.periodCount = 2;
+    gensyn_start_audio_with_options(g, &audio);
+
+    // the device is opened on its own thread.
+    gensyn_system_audio_info_t info;
+    double end = now() + 2;
+    while(!gensyn_system_get_audio_info(gensyn_get_system(g), &info) && now() < end) {
+        sleep_us(EDIT_WAIT_US);
+    }
+    if (!info.running) {
+        printf("FAILED: could not open %s\n", device);
+        return 1;
+    }
+
+    churn(g, seconds);
+    mass_remove(g);
+
+    long bad = atomic_load(&badBlocks);
+    if (!atomic_load(&goodBlocks) || bad) {
+        printf("FAILED: %ld blocks saw a half-applied edit\n", bad);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <gensyn/oscillator.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+
+// Checks and times the wavetable oscillator against the per-sample
+// sin() that Sine_Wave used before it. The sine is compared with
+// sin() for accuracy, then each way of generating a 440 Hz sine is
+// timed on 256-sample blocks. Lastly, each band-limited shape is run
+// near the top of the range, where its peak must stay within [-1, 1].
+//
+// The figures are only meaningful without the sanitizers, e.g.
+//     make OPTS="-O2 -I./include/"
+//
+// Usage: oscillator-bench [blocks]
+
+
+#define BLOCK_SIZE     256
+#define SAMPLE_RATE    44100
+#define HZ             440
+#define CHECK_BLOCKS   100
+#define MAX_ERROR      0.0001
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+
+// Sine_Wave before the oscillator: one sin() per sample
+// from the sample tick.
+static void run_sin(gensyn_sample_t * out, uint64_t * tick, float hz) {
+    uint32_t i;
+    for(i = 0; i < BLOCK_SIZE; ++i) {
+        out[i] = sin(2*M_PI*(hz*((*tick)++ / (float)SAMPLE_RATE)));
+    }
+}
+
+
+
+int main(int argc, char ** argv) {
+    uint32_t blocks = argc > 1 ? atoi(argv[1]) : 20000;
+    gensyn_sample_t out[BLOCK_SIZE];
+    gensyn_sample_t hz[BLOCK_SIZE];
+    gensyn_oscillator_t osc;
+    uint32_t b, i;
+    volatile float sink = 0;
+
+    gensyn_oscillator_init(&osc, GENSYN_OSCILLATOR__SHAPE__SINE);
+    double error = 0;
+    for(b = 0; b < CHECK_BLOCKS; ++b) {
+        gensyn_oscillator_run(&osc, out, BLOCK_SIZE, HZ, SAMPLE_RATE);
+        for(i = 0; i < BLOCK_SIZE; ++i) {
+            double expected = sin(2*M_PI*HZ*(b*BLOCK_SIZE + i) / (double)SAMPLE_RATE);
+            if (fabs(expected - out[i]) > error) error = fabs(expected - out[i]);
+        }
+    }
+    printf("sine: max error against sin() %g\n", error);
+    if (error > MAX_ERROR) {
+        printf("FAILED: error is over %g\n", MAX_ERROR);
+        return 1;
+    }
+
+
+    uint64_t tick = 0;
+    double start = now();
+    for(b = 0; b < blocks; ++b) {
+        run_sin(out, &tick, HZ);
+        sink += out[7];
+    }
+    double sinTime = now() - start;
+
+    start = now();
+    for(b = 0; b < blocks; ++b) {
+        for(i = 0; i < BLOCK_SIZE; ++i) hz[i] = HZ;
+        gensyn_oscillator_run_modulated(&osc, out, hz, NULL, BLOCK_SIZE, SAMPLE_RATE);
+        sink += out[7];
+    }
+    double modulatedTime = now() - start;
+
+    start = now();
+    for(b = 0; b < blocks; ++b) {
+        gensyn_oscillator_run(&osc, out, BLOCK_SIZE, HZ, SAMPLE_RATE);
+        sink += out[7];
+    }
+    double fixedTime = now() - start;
+
+    double samples = (double)blocks * BLOCK_SIZE;
+    printf("\nns per sample over %u blocks of %d:\n", blocks, BLOCK_SIZE);
+    printf("  per-sample sin():   %6.2f\n", sinTime*1e9 / samples);
+    printf("  run_modulated:      %6.2f (%.1fx)\n", modulatedTime*1e9 / samples, sinTime / modulatedTime);
+    printf("  run, fixed hz:      %6.2f (%.1fx)\n", fixedTime*1e9 / samples, sinTime / fixedTime);
+
+
+    const char * names[] = {"saw", "square", "triangle"};
+    gensyn_oscillator__shape_e shapes[] = {
+        GENSYN_OSCILLATOR__SHAPE__SAW,
+        GENSYN_OSCILLATOR__SHAPE__SQUARE,
+        GENSYN_OSCILLATOR__SHAPE__TRIANGLE
+    };
+    printf("\n");
+    for(b = 0; b < 3; ++b) {
+        gensyn_oscillator_init(&osc, shapes[b]);
+        float peak = 0;
+        for(i = 0; i < CHECK_BLOCKS; ++i) {
+            gensyn_oscillator_run(&osc, out, BLOCK_SIZE, 5000, SAMPLE_RATE);
+            uint32_t n;
+            for(n = 0; n < BLOCK_SIZE; ++n) {
+                if (fabsf(out[n]) > peak) peak = fabsf(out[n]);
+            }
+        }
+        printf("%s at 5 kHz: peak %f\n", names[b], peak);
+        if (peak > 1.f) {
+            printf("FAILED: %s goes past 1\n", names[b]);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <gensyn/gensyn.h>
+#include <gensyn/gate.h>
+#include <gensyn/pool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// Times loading, compiling and running a large patch built straight
+// from C. Each branch is an input into a glider into a sine, with an
+// LFO on the sine's velocity, and the branches are summed by a tree
+// of adders, 8 inputs each. Small unrelated allocations are made
+// between the gates, as a long-running program would, so that gates
+// are not laid out next to each other by luck. A hash of the output
+// is printed, so builds can be checked to give the same samples.
+//
+// The figures are only meaningful without the sanitizers, e.g.
+//     make OPTS="-O2 -I./include/"
+//
+// Usage: patch-bench [branches] [blocks] [workers]
+
+
+#define BLOCK_SIZE     256
+#define SAMPLE_RATE    44100
+#define ADDER_INPUTS   8
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+// Gates made straight from C are the caller's to destroy.
+static gensyn_gate_t ** gates;
+static uint32_t gateCount;
+
+static gensyn_gate_t * add_gate(gensyn_t * g, const char * type, void ** junk, size_t junkSize) {
+    if (junk) *junk = malloc(junkSize);
+    return gates[gateCount++] = gensyn_gate_create(g, GENSYN_STR_CAST(type));
+}
+
+
+
+int main(int argc, char ** argv) {
+    uint32_t branches = argc > 1 ? atoi(argv[1]) : 16384;
+    uint32_t blocks   = argc > 2 ? atoi(argv[2]) : 200;
+    uint32_t workers  = argc > 3 ? atoi(argv[3]) : 0;
+    if (!branches) branches = 1;
+
+    gensyn_create_options_t options;
+    gensyn_create_options_init(&options);
+    options.inputLoop = 0;
+    options.probeDevices = 0;
+    options.audio = 0;
+    gensyn_t * g = gensyn_create_with_options(&options);
+
+    void ** junk = malloc(sizeof(void *)*branches*4);
+    gensyn_gate_t ** level = malloc(sizeof(gensyn_gate_t *)*branches);
+    gates = malloc(sizeof(gensyn_gate_t *)*branches*5);
+    uint32_t count = 0;
+    uint32_t i, k;
+    char name[32];
+
+    double start = now();
+    for(i = 0; i < branches; ++i) {
+        gensyn_gate_t * pitch = add_gate(g, "Simple_Input", junk+4*i,   48);
+        gensyn_gate_t * glide = add_gate(g, "Glider",       junk+4*i+1, 80);
+        gensyn_gate_t * lfo   = add_gate(g, "Simple_LFO",   junk+4*i+2, 32);
+        gensyn_gate_t * wave  = add_gate(g, "Sine_Wave",    junk+4*i+3, 64);
+        gensyn_gate_set_parameter(pitch, GENSYN_STR_CAST("value"), -0.9f + (i%100)*0.005f);
+        gensyn_gate_set_parameter(glide, GENSYN_STR_CAST("interp_amount"), 0.5f);
+        gensyn_gate_connect(pitch, GENSYN_STR_CAST("input"), glide);
+        gensyn_gate_connect(glide, GENSYN_STR_CAST("pitch"), wave);
+        gensyn_gate_connect(lfo, GENSYN_STR_CAST("velocity"), wave);
+        level[count++] = wave;
+    }
+    while(count > 1) {
+        uint32_t next = 0;
+        for(i = 0; i < count; i += ADDER_INPUTS) {
+            gensyn_gate_t * adder = add_gate(g, "Adder", NULL, 0);
+            for(k = 0; k < ADDER_INPUTS && i+k < count; ++k) {
+                snprintf(name, sizeof(name), "input%u", k);
+                gensyn_gate_connect(level[i+k], GENSYN_STR_CAST(name), adder);
+            }
+            level[next++] = adder;
+        }
+        count = next;
+    }
+    double loadTime = now() - start;
+
+    gensyn_gate_plan_t * plan = gensyn_gate_plan_create();
+    gensyn_pool_t * pool = workers ? gensyn_pool_create(workers) : NULL;
+    gensyn_gate_plan_set_pool(plan, pool);
+    start = now();
+    gensyn_gate_plan_compile(plan, level[0]);
+    double compileTime = now() - start;
+
+    gensyn_sample_t out[BLOCK_SIZE];
+    uint64_t hash = 1469598103934665603ull;
+    start = now();
+    for(i = 0; i < blocks; ++i) {
+        gensyn_gate_plan_run(plan, out, BLOCK_SIZE, SAMPLE_RATE);
+        const uint8_t * bytes = (const uint8_t *)out;
+        for(k = 0; k < sizeof(out); ++k) {
+            hash = (hash ^ bytes[k]) * 1099511628211ull;
+        }
+    }
+    double runTime = now() - start;
+
+    printf("%u branches, %u gates, %u levels, %u workers\n",
+        branches,
+        gensyn_gate_plan_get_gate_count(plan),
+        gensyn_gate_plan_get_level_count(plan),
+        workers
+    );
+    printf("load    %.4f s\n", loadTime);
+    printf("compile %.4f s\n", compileTime);
+    printf("run     %.4f s for %u blocks of %d\n", runTime, blocks, BLOCK_SIZE);
+    printf("output hash %016llx\n", (unsigned long long)hash);
+
+    gensyn_gate_plan_destroy(plan);
+    if (pool) gensyn_pool_destroy(pool);
+    for(i = 0; i < gateCount; ++i) gensyn_gate_destroy(gates[i]);
+    gensyn_destroy(g);
+    for(i = 0; i < branches*4; ++i) free(junk[i]);
+    free(junk);
+    free(level);
+    free(gates);
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <gensyn/gensyn.h>
+#include <gensyn/pool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+// Checks that running gates on worker threads changes nothing.
+// First, batches of every size up to BATCH_MAX are run on pools
+// with up to WORKERS_MAX workers, and every task must run exactly
+// once. If the test may use SCHED_FIFO, the calling thread then
+// switches to it after the pool is made, like the audio thread 
+// does, and every task must run under it too. Lastly, a branching 
+// patch is rendered with 0 workers and again with 1 up to 
+// WORKERS_MAX workers, and the output must match sample for 
+// sample. The render time is printed for each.
+//
+// Usage: pool-test [blocks]
+
+
+#define WORKERS_MAX    4
+#define BATCH_MAX      300
+#define BATCH_REPEAT   200
+#define BLOCK_SIZE     256
+#define SAMPLE_RATE    44100
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+
+
+static void count_task(void * data, uint32_t index) {
+    atomic_uint * counts = data;
+    atomic_fetch_add(counts+index, 1);
+}
+
+static int check_pool(uint32_t workerCount) {
+    gensyn_pool_t * pool = gensyn_pool_create(workerCount);
+    atomic_uint counts[BATCH_MAX];
+    uint32_t size, n, i;
+    for(n = 0; n < BATCH_REPEAT; ++n) {
+        for(size = 1; size <= BATCH_MAX; size += 1 + n % 7) {
+            for(i = 0; i < size; ++i) atomic_init(counts+i, 0);
+            gensyn_pool_run(pool, size, count_task, counts);
+            for(i = 0; i < size; ++i) {
+                if (atomic_load(counts+i) != 1) {
+                    printf("FAILED: %u workers, task %u of %u ran %u times\n", workerCount, i, size, atomic_load(counts+i));
+                    gensyn_pool_destroy(pool);
+                    return 0;
+                }
+            }
+        }
+    }
+    gensyn_pool_destroy(pool);
+    return 1;
+}
+
+
+
+typedef struct {
+    pthread_t caller;
+    atomic_uint onWorkers;
+    atomic_uint wrong;
+} policy_check_t;
+
+static void policy_task(void * data, uint32_t index) {
+    policy_check_t * check = data;
+    struct sched_param param;
+    int policy;
+    if (pthread_equal(pthread_self(), check->caller)) return;
+    atomic_fetch_add(&check->onWorkers, 1);
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    if (policy != SCHED_FIFO) atomic_fetch_add(&check->wrong, 1);
+}
+
+// Returns -1 if the test may not use SCHED_FIFO, or else 
+// adds the number of tasks that ran on workers to onWorkers.
+// With a single CPU, the caller may run all of them.
+static int check_policy(uint32_t workerCount, uint32_t * onWorkers) {
+    gensyn_pool_t * pool = gensyn_pool_create(workerCount);
+    struct sched_param param = {0};
+    struct sched_param old;
+    int oldPolicy;
+    pthread_getschedparam(pthread_self(), &oldPolicy, &old);
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        gensyn_pool_destroy(pool);
+        return -1;
+    }
+
+    policy_check_t check;
+    check.caller = pthread_self();
+    atomic_init(&check.onWorkers, 0);
+    atomic_init(&check.wrong, 0);
+    uint32_t n;
+    for(n = 0; n < BATCH_REPEAT; ++n) {
+        gensyn_pool_run(pool, BATCH_MAX, policy_task, &check);
+    }
+    pthread_setschedparam(pthread_self(), oldPolicy, &old);
+    gensyn_pool_destroy(pool);
+    if (atomic_load(&check.wrong)) {
+        printf("FAILED: %u workers, %u tasks ran without the caller's policy\n", workerCount, atomic_load(&check.wrong));
+        return 0;
+    }
+    *onWorkers += atomic_load(&check.onWorkers);
+    return 1;
+}
+
+
+
+// Eight groups of eight detuned voices, each voice with its
+// own vibrato, mixed in two levels.
+static gensyn_t * create_patch(uint32_t workerCount) {
+    gensyn_create_options_t options;
+    gensyn_create_options_init(&options);
+    options.inputLoop = 0;
+    options.probeDevices = 0;
+    options.audio = 0;
+    gensyn_t * g = gensyn_create_with_options(&options);
+    gensyn_set_worker_count(g, workerCount);
+    gensyn_send_command(g, GENSYN_STR_CAST(
+        "var mix = gensyn.gate.add('Adder', 'mix');"
+        "for(var v = 0; v < 8; ++v) {"
+        "    var group = gensyn.gate.add('Adder', 'group'+v);"
+        "    for(var k = 0; k < 8; ++k) {"
+        "        var id = v*8+k;"
+        "        var pitch = gensyn.gate.add('Simple_Input', 'pitch'+id);"
+        "        pitch.setParam('value', -0.95 + 0.01*id);"
+        "        var lfo = gensyn.gate.add('Simple_LFO', 'lfo'+id);"
+        "        lfo.setParam('hz', 3 + id*0.1);"
+        "        lfo.setParam('max', 0.01);"
+        "        var sum = gensyn.gate.add('Adder', 'sum'+id);"
+        "        pitch.connectTo('input0', sum);"
+        "        lfo.connectTo('input1', sum);"
+        "        var glide = gensyn.gate.add('Glider', 'glide'+id);"
+        "        sum.connectTo('input', glide);"
+        "        var wave = gensyn.gate.add('Sine_Wave', 'wave'+id);"
+        "        glide.connectTo('pitch', wave);"
+        "        wave.connectTo('input'+k, group);"
+        "    }"
+        "    group.setParam('normalize', 1);"
+        "    group.connectTo('input'+v, mix);"
+        "}"
+        "mix.setParam('normalize', 1);"
+        "mix.connectTo('waveform', gensyn.getOutput());"
+    ));
+    return g;
+}
+
+static gensyn_sample_t * render(uint32_t workerCount, uint32_t blocks) {
+    gensyn_t * g = create_patch(workerCount);
+    gensyn_sample_t * samples = malloc(sizeof(gensyn_sample_t)*BLOCK_SIZE*blocks);
+    uint32_t i;
+    double start = now();
+    for(i = 0; i < blocks; ++i) {
+        gensyn_generate_waveform(g, samples + i*BLOCK_SIZE, BLOCK_SIZE, SAMPLE_RATE);
+    }
+    printf("%u workers: %.3f s for %u blocks\n", workerCount, now() - start, blocks);
+    gensyn_destroy(g);
+    return samples;
+}
+
+
+
+int main(int argc, char ** argv) {
+    uint32_t blocks = argc > 1 ? atoi(argv[1]) : 1000;
+    uint32_t i;
+    for(i = 0; i <= WORKERS_MAX; ++i) {
+        if (!check_pool(i)) return 1;
+    }
+    printf("pool: every task ran once\n");
+    uint32_t onWorkers = 0;
+    for(i = 1; i <= WORKERS_MAX; ++i) {
+        int result = check_policy(i, &onWorkers);
+        if (!result) return 1;
+        if (result < 0) {
+            printf("pool: SCHED_FIFO not allowed, policy not checked\n");
+            break;
+        }
+    }
+    if (i > WORKERS_MAX) printf("pool: %u tasks ran on workers, all under the caller's policy\n", onWorkers);
+
+    gensyn_sample_t * expected = render(0, blocks);
+    for(i = 1; i <= WORKERS_MAX; ++i) {
+        gensyn_sample_t * samples = render(i, blocks);
+        if (memcmp(expected, samples, sizeof(gensyn_sample_t)*BLOCK_SIZE*blocks)) {
+            printf("FAILED: output with %u workers differs from 0 workers\n", i);
+            return 1;
+        }
+        free(samples);
+    }
+    free(expected);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <gensyn/ring.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+
+// Stress test and throughput benchmark for the ring.
+// One thread writes an increasing sequence while another
+// reads it back, each using every way of pushing and popping.
+// Any lost, repeated or torn element ends the test.
+
+
+#define STRESS_COUNT   20000000
+#define BENCH_COUNT    100000000
+#define RING_SIZE      1024
+#define BATCH_MAX      64
+
+
+typedef struct {
+    uint64_t value;
+    uint64_t check;
+} element_t;
+
+
+typedef struct {
+    gensyn_ring_t * ring;
+    uint64_t count;
+    int batched;
+} job_t;
+
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static element_t make_element(uint64_t value) {
+    element_t e;
+    e.value = value;
+    e.check = ~value * 0x9e3779b97f4a7c15ull;
+    return e;
+}
+
+
+
+
+static int stress_writer(void * data) {
+    job_t * job = data;
+    element_t batch[BATCH_MAX];
+    uint64_t next = 0;
+    uint32_t i, n, available;
+
+    while(next < job->count) {
+        switch(next % 3) {
+          // one at a time
+          case 0: {
+            element_t e = make_element(next);
+            if (gensyn_ring_push(job->ring, e)) next++;
+            else thrd_yield();
+            break;
+          }
+
+          // copied in batches
+          case 1:
+            n = 1 + next % BATCH_MAX;
+            if (n > job->count - next) n = job->count - next;
+            for(i = 0; i < n; ++i) batch[i] = make_element(next+i);
+            n = gensyn_ring_push_n(job->ring, batch, n);
+            if (n) next += n;
+            else thrd_yield();
+            break;
+
+          // written in place
+          case 2: {
+            n = 1 + next % BATCH_MAX;
+            if (n > job->count - next) n = job->count - next;
+            element_t * dest = gensyn_ring_reserve(job->ring, n, &available);
+            if (!dest) {
+                thrd_yield();
+                break;
+            }
+            for(i = 0; i < available; ++i) dest[i] = make_element(next+i);
+            gensyn_ring_commit(job->ring, available);
+            next += available;
+            break;
+          }
+        }
+    }
+    return 0;
+}
+
+
+static int stress_check(const element_t * e, uint64_t expected) {
+    element_t good = make_element(expected);
+    if (e->value != good.value || e->check != good.check) {
+        printf(
+            "FAILED: expected element %llu, got %llu (check %s)\n",
+            (unsigned long long)expected,
+            (unsigned long long)e->value,
+            e->check == make_element(e->value).check ? "ok" : "torn"
+        );
+        exit(1);
+    }
+    return 1;
+}
+
+static void stress(uint32_t ringSize) {
+    job_t job;
+    job.ring = gensyn_ring_create(sizeof(element_t), ringSize);
+    job.count = STRESS_COUNT;
+
+    thrd_t writer;
+    double start = now();
+    thrd_create(&writer, stress_writer, &job);
+
+    element_t batch[BATCH_MAX];
+    uint64_t next = 0;
+    uint32_t i, n, available;
+    while(next < job.count) {
+        switch(next % 4) {
+          case 0: {
+            element_t e;
+            if (gensyn_ring_pop(job.ring, e)) stress_check(&e, next++);
+            else thrd_yield();
+            break;
+          }
+
+          case 1:
+          case 2:
+            n = gensyn_ring_pop_n(job.ring, batch, 1 + next % BATCH_MAX);
+            if (!n) thrd_yield();
+            for(i = 0; i < n; ++i) stress_check(batch+i, next++);
+            break;
+
+          case 3: {
+            const element_t * src = gensyn_ring_peek(job.ring, &available);
+            if (!src) {
+                thrd_yield();
+                break;
+            }
+            if (available > BATCH_MAX) available = BATCH_MAX;
+            for(i = 0; i < available; ++i) stress_check(src+i, next++);
+            gensyn_ring_release(job.ring, available);
+            break;
+          }
+        }
+    }
+    thrd_join(writer, NULL);
+
+    if (gensyn_ring_has_pending(job.ring)) {
+        printf("FAILED: ring should be empty\n");
+        exit(1);
+    }
+    printf(
+        "stress: %d elements through a ring of %u: ok (%.2fs)\n",
+        STRESS_COUNT,
+        gensyn_ring_get_capacity(job.ring),
+        now() - start
+    );
+    gensyn_ring_destroy(job.ring);
+}
+
+
+
+
+
+static int bench_writer(void * data) {
+    job_t * job = data;
+    uint32_t batch[BATCH_MAX];
+    uint64_t next = 0;
+    uint32_t i;
+
+    while(next < job->count) {
+        if (job->batched) {
+            uint32_t n = BATCH_MAX;
+            if (n > job->count - next) n = job->count - next;
+            for(i = 0; i < n; ++i) batch[i] = next+i;
+            n = gensyn_ring_push_n(job->ring, batch, n);
+            if (!n) thrd_yield();
+            next += n;
+        } else {
+            uint32_t v = next;
+            if (gensyn_ring_push(job->ring, v)) next++;
+            else thrd_yield();
+        }
+    }
+    return 0;
+}
+
+static void bench(int batched) {
+    job_t job;
+    job.ring = gensyn_ring_create(sizeof(uint32_t), RING_SIZE);
+    job.count = BENCH_COUNT;
+    job.batched = batched;
+
+    uint32_t batch[BATCH_MAX];
+    uint64_t next = 0;
+    uint64_t sum = 0;
+    uint32_t i;
+
+    thrd_t writer;
+    double start = now();
+    thrd_create(&writer, bench_writer, &job);
+    while(next < job.count) {
+        if (batched) {
+            uint32_t n = gensyn_ring_pop_n(job.ring, batch, BATCH_MAX);
+            if (!n) thrd_yield();
+            for(i = 0; i < n; ++i) sum += batch[i];
+            next += n;
+        } else {
+            uint32_t v;
+            if (gensyn_ring_pop(job.ring, v)) {
+                sum += v;
+                next++;
+            } else {
+                thrd_yield();
+            }
+        }
+    }
+    thrd_join(writer, NULL);
+    double elapsed = now() - start;
+
+    printf(
+        "bench (%s): %.1f million elements/s (sum %llu)\n",
+        batched ? "batches of 64" : "one at a time",
+        BENCH_COUNT / elapsed / 1000000.0,
+        (unsigned long long)sum
+    );
+    gensyn_ring_destroy(job.ring);
+}
+
+
+
+
+int main() {
+    // a tiny ring wraps constantly and is almost always full or empty
+    stress(4);
+    stress(RING_SIZE);
+
+    bench(0);
+    bench(1);
+    return 0;
+}
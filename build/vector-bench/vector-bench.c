@@ -0,0 +1,229 @@
+#include <gensyn/vector.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+
+// Checks and times the vector kernels for each set the CPU supports.
+// Every kernel is first run by each set on the same inputs, for every
+// length up to CHECK_MAX and from an unaligned start, with NaNs,
+// infinities and signed zeros mixed in. The output must match the
+// plain C kernels bit for bit, except that which NaN comes out of 
+// adding two NaNs depends on the order of the operands. Then each 
+// kernel is timed on buffers of BENCH_SIZE samples, the usual size 
+// of a block.
+//
+// Usage: vector-bench [iterations]
+
+
+#define CHECK_MAX      67
+#define BENCH_SIZE     256
+#define SUM_INPUTS     8
+
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static float random_sample(int special) {
+    if (special) {
+        switch(rand() % 6) {
+          case 0: return NAN;
+          case 1: return -NAN;
+          case 2: return INFINITY;
+          case 3: return -INFINITY;
+          case 4: return -0.f;
+          case 5: return 0.f;
+        }
+    }
+    return (rand() / (float)RAND_MAX) * 4.f - 2.f;
+}
+
+
+
+typedef enum {
+    KERNEL__FILL,
+    KERNEL__SCALE,
+    KERNEL__CLAMP,
+    KERNEL__MIX,
+    KERNEL__MULTIPLY,
+    KERNEL__MULTIPLY_ADD,
+    KERNEL__PEAK,
+    KERNEL__SUM_SCALED,
+    KERNEL__COUNT
+} kernel_e;
+
+static const char * kernelNames[] = {
+    "fill",
+    "scale",
+    "clamp",
+    "mix",
+    "multiply",
+    "multiply_add",
+    "peak",
+    "sum_scaled"
+};
+
+
+// The buffers a kernel reads and writes. out starts as a copy
+// of init, since some kernels also read it.
+typedef struct {
+    gensyn_sample_t init[BENCH_SIZE+1];
+    gensyn_sample_t out [BENCH_SIZE+1];
+    gensyn_sample_t a   [BENCH_SIZE+1];
+    gensyn_sample_t b   [BENCH_SIZE+1];
+    gensyn_sample_t ins [SUM_INPUTS][BENCH_SIZE+1];
+    float gains[SUM_INPUTS];
+    float peak;
+} buffers_t;
+
+
+static void fill_buffers(buffers_t * b, int special) {
+    uint32_t i, k;
+    for(i = 0; i < BENCH_SIZE+1; ++i) {
+        b->init[i] = random_sample(special && rand() % 4 == 0);
+        b->a[i]    = random_sample(special && rand() % 4 == 0);
+        b->b[i]    = random_sample(special && rand() % 4 == 0);
+        for(k = 0; k < SUM_INPUTS; ++k) {
+            b->ins[k][i] = random_sample(special && rand() % 4 == 0);
+        }
+    }
+    for(k = 0; k < SUM_INPUTS; ++k) {
+        b->gains[k] = random_sample(0);
+    }
+}
+
+
+// Runs the kernel on count samples, starting offset into each buffer.
+static void run_kernel(kernel_e kernel, buffers_t * b, uint32_t offset, uint32_t count) {
+    gensyn_sample_t * out = b->out + offset;
+    const gensyn_sample_t * ins[SUM_INPUTS];
+    uint32_t k;
+    switch(kernel) {
+      case KERNEL__FILL:         gensyn_vector_fill(out, b->a[0], count); break;
+      case KERNEL__SCALE:        gensyn_vector_scale(out, b->a+offset, 0.75f, count); break;
+      case KERNEL__CLAMP:        gensyn_vector_clamp(out, b->a+offset, -1.f, 1.f, count); break;
+      case KERNEL__MIX:          gensyn_vector_mix(out, b->a+offset, count); break;
+      case KERNEL__MULTIPLY:     gensyn_vector_multiply(out, b->a+offset, count); break;
+      case KERNEL__MULTIPLY_ADD: gensyn_vector_multiply_add(out, b->a+offset, b->b+offset, count); break;
+      case KERNEL__PEAK:         b->peak = gensyn_vector_peak(b->a+offset, count); break;
+      case KERNEL__SUM_SCALED:
+        for(k = 0; k < SUM_INPUTS; ++k) ins[k] = b->ins[k]+offset;
+        gensyn_vector_sum_scaled(out, ins, b->gains, SUM_INPUTS, count);
+        break;
+      default:;
+    }
+}
+
+
+
+// Whether the samples are the same bits, or both NaN.
+static int same_samples(const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        if (memcmp(a+i, b+i, sizeof(gensyn_sample_t)) && !(isnan(a[i]) && isnan(b[i]))) return 0;
+    }
+    return 1;
+}
+
+
+// Compares the set's output for every kernel, length and
+// start against the plain C kernels. Returns 0 on a mismatch.
+static int check_isa(gensyn_vector__isa_e isa, buffers_t * b) {
+    buffers_t expected;
+    kernel_e kernel;
+    uint32_t offset, count;
+    for(kernel = 0; kernel < KERNEL__COUNT; ++kernel) {
+        for(offset = 0; offset < 2; ++offset) {
+            for(count = 0; count <= CHECK_MAX; ++count) {
+                memcpy(b->out, b->init, sizeof(b->out));
+                expected = *b;
+                gensyn_vector_set_isa(GENSYN_VECTOR__ISA__SCALAR);
+                run_kernel(kernel, &expected, offset, count);
+                gensyn_vector_set_isa(isa);
+                run_kernel(kernel, b, offset, count);
+
+                if (!same_samples(expected.out, b->out, BENCH_SIZE+1) ||
+                    !same_samples(&expected.peak, &b->peak, 1)) {
+                    printf(
+                        "FAILED: %s %s differs from %s for %u samples from %u\n",
+                        gensyn_vector_get_isa_name(isa), kernelNames[kernel],
+                        gensyn_vector_get_isa_name(GENSYN_VECTOR__ISA__SCALAR),
+                        count, offset
+                    );
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+
+// Returns the nanoseconds per call of the kernel.
+static double time_kernel(kernel_e kernel, buffers_t * b, uint32_t iterations) {
+    uint32_t i;
+    double start = now();
+    for(i = 0; i < iterations; ++i) {
+        // keeps mix and multiply from running off to infinity or 0.
+        if (i % 64 == 0) memcpy(b->out, b->init, sizeof(b->out));
+        run_kernel(kernel, b, 0, BENCH_SIZE);
+    }
+    return (now() - start) * 1000000000.0 / iterations;
+}
+
+
+
+
+int main(int argc, char ** argv) {
+    uint32_t iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    gensyn_vector__isa_e isas[] = {
+        GENSYN_VECTOR__ISA__SCALAR,
+        GENSYN_VECTOR__ISA__SSE2,
+        GENSYN_VECTOR__ISA__AVX2
+    };
+    uint32_t isaCount = sizeof(isas)/sizeof(isas[0]);
+    int supported[sizeof(isas)/sizeof(isas[0])];
+    buffers_t * b = malloc(sizeof(buffers_t));
+    uint32_t i, n;
+    kernel_e kernel;
+
+    srand(1);
+    for(i = 0; i < isaCount; ++i) {
+        supported[i] = gensyn_vector_set_isa(isas[i]);
+        if (!supported[i] || isas[i] == GENSYN_VECTOR__ISA__SCALAR) continue;
+        for(n = 0; n < 100; ++n) {
+            fill_buffers(b, n % 2);
+            if (!check_isa(isas[i], b)) {
+                free(b);
+                return 1;
+            }
+        }
+        printf("%s: same output as %s\n", gensyn_vector_get_isa_name(isas[i]), gensyn_vector_get_isa_name(GENSYN_VECTOR__ISA__SCALAR));
+    }
+
+
+    printf("\nns per call on %d samples:\n%-14s", BENCH_SIZE, "");
+    for(i = 0; i < isaCount; ++i) {
+        if (supported[i]) printf("%10s", gensyn_vector_get_isa_name(isas[i]));
+    }
+    printf("\n");
+
+    fill_buffers(b, 0);
+    for(kernel = 0; kernel < KERNEL__COUNT; ++kernel) {
+        printf("%-14s", kernelNames[kernel]);
+        for(i = 0; i < isaCount; ++i) {
+            if (!supported[i]) continue;
+            gensyn_vector_set_isa(isas[i]);
+            printf("%10.1f", time_kernel(kernel, b, iterations));
+        }
+        printf("\n");
+    }
+    free(b);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef H_GENSYNDC__ARENA__INCLUDED
+#define H_GENSYNDC__ARENA__INCLUDED
+
+
+#include <stdint.h>
+
+/*
+
+    Arena
+    -----
+
+    Hands out fixed-size slots from large, cache-line aligned
+    chunks, so that objects of the same kind end up next to
+    each other in memory rather than scattered across the heap.
+    Freed slots are kept and handed out again; chunks are only
+    released when the arena is destroyed.
+
+    An arena is not thread-safe. Only one thread at a time
+    may allocate from it or free to it.
+
+*/
+typedef struct gensyn_arena_t gensyn_arena_t;
+
+
+
+/// Returns a new, empty arena of slots at least slotSize bytes large.
+/// Each slot starts on a cache line. The first chunk holds
+/// slotsPerChunk slots, and each one after is twice as large as
+/// the last, up to a limit.
+gensyn_arena_t * gensyn_arena_create(uint32_t slotSize, uint32_t slotsPerChunk);
+
+/// Destroys the arena and every slot in it, whether freed or not.
+void gensyn_arena_destroy(gensyn_arena_t *);
+
+/// Returns the size of each slot, which is slotSize rounded up
+/// to a whole number of cache lines.
+uint32_t gensyn_arena_get_slot_size(const gensyn_arena_t *);
+
+/// Returns the number of slots handed out and not yet freed.
+uint32_t gensyn_arena_get_count(const gensyn_arena_t *);
+
+/// Returns a slot. Its contents are undefined.
+void * gensyn_arena_alloc(gensyn_arena_t *);
+
+/// Gives back a slot from gensyn_arena_alloc of the same arena.
+/// Does nothing for NULL.
+void gensyn_arena_free(gensyn_arena_t *, void *);
+
+
+#endif
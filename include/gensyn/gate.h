@@ -6,6 +6,7 @@
 #include <gensyn/array.h>
 #include <gensyn/system.h>
 typedef struct gensyn_t gensyn_t;
+typedef struct gensyn_pool_t gensyn_pool_t;
 /*
     GenSyn: Gate 
     
@@ -26,10 +27,36 @@ typedef struct gensyn_t gensyn_t;
 typedef struct gensyn_gate_t gensyn_gate_t;
 
 
+// The gate types registered with a context, along with other 
+// state shared by all the gates of that context. Each gensyn 
+// context owns one, so separate contexts can be used from 
+// separate threads.
+typedef struct gensyn_gate_registry_t gensyn_gate_registry_t;
+
+// Creates a new registry with no gate types.
+gensyn_gate_registry_t * gensyn_gate_registry_create();
+
+// Destroys a registry. All gates created from it must be destroyed first.
+void gensyn_gate_registry_destroy(gensyn_gate_registry_t *);
+
+
+
+
+// An input event as seen by a gate's update.
+typedef struct {
+    // the sample within the update's buffer that 
+    // the event lands on.
+    uint32_t offset;
+    
+    gensyn_system__input_event_t event;
+} gensyn_gate_event_t;
+
+
 
 // Called when the gate is created. This 
 // is done on the same thread as the update and remove functions.
-// userdata is returned.
+// userdata is returned. For gates registered with a data size,
+// this is normally the data from gensyn_gate_get_data.
 typedef void * (*gensyn_gate__create_fn)(gensyn_gate_t *);
 
 // Called when the gate is updated. This 
@@ -50,6 +77,15 @@ typedef int (*gensyn_gate__update_fn)(
     // requirement should be reasonable.
     gensyn_sample_t ** inSampleBuffers, 
 
+    // input events that land within this update, sorted by offset.
+    // Events are captured by the input thread and placed at 
+    // the sample matching when they arrived, one block late, so 
+    // their timing does not depend on when the block runs.
+    const gensyn_gate_event_t * events,
+    
+    // number of events.
+    uint32_t eventCount,
+
     // THe buffer to write results to. If the sampleCount has 
     // not changes since previous frame, the buffer should contain 
     // what was computed last iteration. If not, the buffer will be 
@@ -57,7 +93,9 @@ typedef int (*gensyn_gate__update_fn)(
     gensyn_sample_t * buffer,
 
 
-    // number of samples in each buffer
+    // number of samples in each buffer. When a scheduled parameter
+    // change lands partway through a block, the block is split 
+    // into multiple updates and the buffers point partway into it.
     uint32_t sampleCount,
 
     // The sample rate in Hz.
@@ -66,13 +104,32 @@ typedef int (*gensyn_gate__update_fn)(
     // User-generated data.
     void * userData
 );
+// The update returns one of gensyn_gate__output_e, which says what 
+// the update left in the buffer.
+
+
+// What a gate's update produced.
+typedef enum {
+    // Nothing was written and the output is silent. The buffer
+    // must be left alone and is taken to be all zeros.
+    GENSYN_GATE__OUTPUT__SILENT,
+
+    // The output was written to the buffer.
+    GENSYN_GATE__OUTPUT__WRITTEN,
+    
+    // The output is one value for the whole update, given 
+    // through gensyn_gate_output_constant. The buffer must be 
+    // left alone; it is only filled when the value changes.
+    GENSYN_GATE__OUTPUT__CONSTANT,
+} gensyn_gate__output_e;
 
 // Called when the gate is updated. This 
 // is done on the same thread as the create and remove functions.
 typedef void (*gensyn_gate__remove_fn)(gensyn_gate_t *, void * userData);
 
 // Called when the system receives a new input event. 
-// This is called on its own thread.
+// This is called on its own thread as soon as the event arrives.
+// The same events are given to every gate's update, timed to the sample.
 typedef void (*gensyn_gate__input_fn)(
     gensyn_gate_t *, 
     const gensyn_system__input_event_t * event, 
@@ -105,13 +162,23 @@ typedef enum {
     GENSYN_GATE__PROPERTY__END,
     GENSYN_GATE__PROPERTY__CONNECTION,
     GENSYN_GATE__PROPERTY__PARAM,
+    GENSYN_GATE__PROPERTY__CONTROL_RATE,
+    GENSYN_GATE__PROPERTY__DATA_SIZE,
+    GENSYN_GATE__PROPERTY__CONNECTION_ARRAY,
+    GENSYN_GATE__PROPERTY__PARAM_ARRAY,
 
 } gensyn_gate__property_e;
 
 
+// Number of samples between updates of a control-rate gate.
+// About 1.4 kHz at 44.1 kHz, which is plenty for modulation.
+#define GENSYN_GATE_CONTROL_PERIOD 32
+
+
 
-// Registers a new type of gate that can be instantiated by name 
-// using gensyn_gate_create.
+// Registers a new type of gate with the context that can be 
+// instantiated by name using gensyn_gate_create.
+// context:     the gensyn context to register with.
 // name:        the name of the gate.
 // onCreate:    The creation function for this gate.
 // onUpdate:    The update function for this gate.
@@ -129,11 +196,29 @@ typedef enum {
 //
 //  GENSYN_GATE__PROPERTY_CONNECTION Denotes the next string to be the name of a gate slot as input to this gate.
 //  GENSYN_GATE__PROPERTY_PARAM      Denotes the next string to be the name of an parameter. Then it shall be followed by a double as a default value
+//                                   Parameters are given handles in the order they are declared, starting at 0.
+//  GENSYN_GATE__PROPERTY_CONTROL_RATE Takes no arguments. Marks the gate's output as control-rate: its update 
+//                                   sees one sample for every GENSYN_GATE_CONTROL_PERIOD, taken from the start 
+//                                   of each period, at a matching sample rate. Events are moved to the start of
+//                                   their period, or to the next period start if their part of the block has none.
+//                                   The output is ramped across each period for the gates reading it,
+//                                   which puts it one period behind.
+//  GENSYN_GATE__PROPERTY_DATA_SIZE  Followed by a size_t, usually the sizeof() the gate's user data. The data is then 
+//                                   kept next to the gate, packed with the other gates of the class, and owned by it.
+//                                   It is zeroed and given by gensyn_gate_get_data when the create function is 
+//                                   called, which should then return it, and it must not be freed by the gate.
+//  GENSYN_GATE__PROPERTY_CONNECTION_ARRAY Followed by a string and an int count. Adds count INs named by the string 
+//                                   followed by their index, from 0, such as "input0", "input1" and so on.
+//  GENSYN_GATE__PROPERTY_PARAM_ARRAY Followed by a string, an int count and a double default value. Adds count 
+//                                   parameters named like GENSYN_GATE__PROPERTY_CONNECTION_ARRAY's INs.
+//
+// There is no fixed limit on the number of INs, OUTs or parameters.
 //
 //
 // If the registration is successful, 1 is returned. Otherwise, 0 is returned 
 // and the gate is not registered. 
 int gensyn_gate_register(
+    gensyn_t *                  context,
     
     const gensyn_string_t *     nameClass,
     const gensyn_string_t *     description,
@@ -150,19 +235,26 @@ int gensyn_gate_register(
 
 
 
-// Creates a new gate.
+// Creates a new gate of a type registered with the context.
 gensyn_gate_t *  gensyn_gate_create(gensyn_t *, const gensyn_string_t *);
 
 
 
-// Destroys a gate. 
+// Destroys a gate. The gate must not be part of a plan that 
+// may still be run.
 void gensyn_gate_destroy(gensyn_gate_t *);
 
+// Removes every connection to and from the gate, leaving it 
+// in place for plans that still run it. Gates that are destroyed 
+// while a plan might be running are first cut off with this, 
+// then destroyed once no such plan is left.
+void gensyn_gate_disconnect_all(gensyn_gate_t *);
+
 
 
 
 // Runs the program consisteing of the entire gate circuit
-// connected to this gate. 
+// connected to this gate. No input events are given to the gates.
 void gensyn_gate_run(
     // The gate acting as output. 
     gensyn_gate_t *, 
@@ -179,6 +271,100 @@ void gensyn_gate_run(
 );
 
 
+// A compiled form of the circuit connected to an output gate.
+// Compiling flattens the circuit into a list of gates in
+// dependency order with each gate's input buffers already resolved,
+// so running it requires no recursion or per-gate cycle checks.
+// A plan has to be recompiled whenever the circuit changes.
+//
+// The plan also owns the buffers that the gates write to. Gates
+// whose outputs are never needed at the same time share a buffer,
+// so a large circuit only needs as many buffers as it has outputs 
+// in use at once. Buffers are only allocated when compiling, 
+// so running the plan never allocates.
+typedef struct gensyn_gate_plan_t gensyn_gate_plan_t;
+
+// The most samples a plan runs at once. Longer runs are 
+// split up, so gates never see more than this in one update.
+#define GENSYN_GATE_PLAN_MAX_SAMPLES 1024
+
+
+// Creates a new, empty plan.
+gensyn_gate_plan_t * gensyn_gate_plan_create();
+
+// Destroys a plan. The gates referred to are not affected.
+void gensyn_gate_plan_destroy(gensyn_gate_plan_t *);
+
+// Compiles the circuit connected to the given gate into the plan,
+// replacing any previous contents. If the gate is NULL, the plan is
+// emptied.
+void gensyn_gate_plan_compile(gensyn_gate_plan_t *, gensyn_gate_t * output);
+
+// Compiles the circuits connected to each of the given gates into the 
+// plan, replacing any previous contents. Each gate is an output of its 
+// own, such as one channel; gates that more than one output depends on 
+// are still only run once per run. If outputCount is 0, the plan is emptied.
+void gensyn_gate_plan_compile_outputs(gensyn_gate_plan_t *, gensyn_gate_t ** outputs, uint32_t outputCount);
+
+// Returns the number of outputs that the plan was compiled for.
+uint32_t gensyn_gate_plan_get_output_count(const gensyn_gate_plan_t *);
+
+// Returns the number of gates that are run by the plan.
+uint32_t gensyn_gate_plan_get_gate_count(const gensyn_gate_plan_t *);
+
+// Returns the gate run by the given step of the plan, 
+// or NULL if there is no such step.
+gensyn_gate_t * gensyn_gate_plan_get_gate(const gensyn_gate_plan_t *, uint32_t index);
+
+// Returns the number of levels in the plan. Gates within a level
+// do not depend on each other, so each level can be run in parallel.
+uint32_t gensyn_gate_plan_get_level_count(const gensyn_gate_plan_t *);
+
+// Returns the number of buffers shared by the gates of the plan.
+uint32_t gensyn_gate_plan_get_buffer_count(const gensyn_gate_plan_t *);
+
+// Sets a pool of worker threads to run each level of the plan with.
+// The output is identical to running the plan serially.
+// If NULL, the plan runs on the calling thread only.
+void gensyn_gate_plan_set_pool(gensyn_gate_plan_t *, gensyn_pool_t *);
+
+// Sets the input events given to every gate during the next run of 
+// the plan. The events must be sorted by offset and stay valid until 
+// the run is done. They are only given for one run.
+void gensyn_gate_plan_set_events(gensyn_gate_plan_t *, const gensyn_gate_event_t * events, uint32_t eventCount);
+
+// Runs the compiled circuit. This is equivalent to gensyn_gate_run
+// on the output gate that the plan was compiled with. For plans with 
+// more than one output, only the first output is written.
+void gensyn_gate_plan_run(
+    gensyn_gate_plan_t *,
+
+    // The buffer to be written to. The output gate writes here
+    // directly, so it can be the device's own buffer. It need
+    // not be aligned.
+    gensyn_sample_t *,
+
+    // the number of samples for this buffer
+    uint32_t sampleCount,
+
+    // the sample rate of the device to be using the
+    // buffer, in Hz.
+    float sampleRate
+);
+
+// Runs the compiled circuit once for every output at the same time.
+// samplesOut holds one buffer for each output, in the order given 
+// to gensyn_gate_plan_compile_outputs. Outputs with a NULL buffer 
+// are still run, but not written out. As with gensyn_gate_plan_run,
+// the output gates write to the buffers directly.
+void gensyn_gate_plan_run_planar(
+    gensyn_gate_plan_t *,
+    gensyn_sample_t ** samplesOut,
+    uint32_t sampleCount,
+    float sampleRate
+);
+
+
 // Returns how many samples have been processed by the gate.
 uint64_t gensyn_gate_get_sample_tick(const gensyn_gate_t *);
 
@@ -191,6 +377,30 @@ int gensyn_gate_get_is_active(const gensyn_gate_t *);
 // run and controlled for you.
 void gensyn_gate_reset_is_active(gensyn_gate_t *);
 
+// Returns whether the gate's output for the last block was 
+// silent, in which case its buffer holds only zeros.
+int gensyn_gate_get_is_silent(const gensyn_gate_t *);
+
+// Returns whether the IN at the given index is connected to a 
+// gate whose output for this block is silent. Meant to be called 
+// from the update, where the INs have already been run.
+// Unconnected INs are not silent; their buffers are NULL instead.
+// The INs are those of the circuit being run, which may lag 
+// behind the connections made since.
+int gensyn_gate_get_in_is_silent(const gensyn_gate_t *, int index);
+
+// Returns whether the IN at the given index is connected to a 
+// gate whose output for this block is a single value, which is 
+// written to value. Silent INs are constant with a value of 0.
+// The IN's buffer holds the value as well, so gates that need 
+// the samples can still read them.
+int gensyn_gate_get_in_constant(const gensyn_gate_t *, int index, float * value);
+
+// Called from a gate's update to output one value for the whole 
+// update without writing to the buffer. Returns what the 
+// update should return, GENSYN_GATE__OUTPUT__CONSTANT.
+int gensyn_gate_output_constant(gensyn_gate_t *, float value);
+
 
 
 // Returns a string description for the gate.
@@ -206,7 +416,8 @@ void gensyn_gate_set_x(gensyn_gate_t *, int);
 void gensyn_gate_set_y(gensyn_gate_t *, int);
 
 // Connects a source gate to a destination gate. The first argument acts as the OUT, and the last 
-// argument acts as the IN 
+// argument acts as the IN. Plans that are already compiled keep running 
+// the old connections until they are compiled again.
 void gensyn_gate_connect(
     gensyn_gate_t * from, 
     const gensyn_string_t * inConnection, 
@@ -253,6 +464,69 @@ float gensyn_gate_get_parameter(const gensyn_gate_t *, const gensyn_string_t *);
 void gensyn_gate_set_parameter(gensyn_gate_t *, const gensyn_string_t *, float);
 
 
+// Returns the handle for the named parameter, or -1 if the gate 
+// has no such parameter. A handle is the index of the parameter 
+// in the order it was given to gensyn_gate_register, so it is 
+// the same for every gate of a class. Gates should resolve their 
+// handles once (or define them by registration order) and use the 
+// handle functions below while updating, which do no string comparisons.
+int gensyn_gate_get_parameter_handle(const gensyn_gate_t *, const gensyn_string_t *);
+
+// Returns the value of a parameter by handle.
+float gensyn_gate_get_parameter_by_handle(const gensyn_gate_t *, int handle);
+
+// Sets the value of a parameter by handle. This is safe to call 
+// while the gate is running on another thread: the new value is 
+// applied at the start of the gate's next update, so it never 
+// changes partway through a block. Until then, the getters return 
+// the previous value.
+void gensyn_gate_set_parameter_by_handle(gensyn_gate_t *, int handle, float);
+
+// Sets every parameter of a gate to the value of the same parameter 
+// of another gate of the same class. Values set on the source gate 
+// that it has not applied yet are copied as well, so this also works
+// for gates that are not being run.
+void gensyn_gate_copy_parameters(gensyn_gate_t * to, const gensyn_gate_t * from);
+
+
+
+typedef enum {
+    // The parameter jumps to the new value.
+    GENSYN_GATE__RAMP__NONE,
+
+    // The parameter moves in a straight line to the new value.
+    GENSYN_GATE__RAMP__LINEAR,
+
+    // The parameter moves exponentially to the new value, which 
+    // sounds even for volumes and pitches. If either value is 0 or 
+    // they differ in sign, this is the same as linear.
+    GENSYN_GATE__RAMP__EXPONENTIAL,
+
+} gensyn_gate__ramp_e;
+
+
+// Schedules a parameter change to start at an exact sample.
+// sampleTick is in terms of gensyn_gate_get_sample_tick for the gate;
+// changes for ticks that have already passed start at the beginning 
+// of the next update. With a ramp, the parameter reaches the value 
+// rampLength samples after the change starts. It moves in steps of 
+// rampLength/8 samples, but no more than 32 and at least 1; each step 
+// holds the value due at its end, so the first step already moves.
+//
+// Changes are passed to the gate through a lock-free queue, so 
+// this is safe to call while the gate is running on another thread,
+// as long as only one thread schedules changes for each gate.
+// If too many changes are waiting, 0 is returned and the change is dropped.
+int gensyn_gate_schedule_parameter(
+    gensyn_gate_t *, 
+    int handle, 
+    float value,
+    uint64_t sampleTick,
+    gensyn_gate__ramp_e ramp,
+    uint32_t rampLength
+);
+
+
 
 
 
@@ -267,6 +541,9 @@ const gensyn_string_t * gensyn_gate_get_class(const gensyn_gate_t *);
 // Returns whether this gate reacts to input
 int gensyn_gate_reads_input(const gensyn_gate_t *);
 
+// Returns the user data returned by the gate's create function.
+void * gensyn_gate_get_data(const gensyn_gate_t *);
+
 // Returns the input function for this gate
 void gensyn_gate_send_event(gensyn_gate_t *, const gensyn_system__input_event_t * event);
 
@@ -3,8 +3,10 @@
 
 #include <gensyn/string.h>
 #include <gensyn/sample.h>
+#include <gensyn/system.h>
 typedef struct gensyn_gate_t   gensyn_gate_t;
 typedef struct gensyn_system_t gensyn_system_t;
+typedef struct gensyn_gate_registry_t gensyn_gate_registry_t;
 
 
 
@@ -14,18 +16,80 @@ typedef struct gensyn_t gensyn_t;
 
 
 
+// What a new context should set up. Contexts that only render
+// can turn everything off, in which case no system instance
+// is created at all.
+typedef struct {
+    // Whether to run the input thread, which delivers 
+    // events from input devices to gates.
+    int inputLoop;
 
+    // Whether the input thread looks for newly connected 
+    // MIDI devices once a second. Probing runs an external 
+    // program each time.
+    int probeDevices;
 
+    // Whether gensyn_start_audio may open the audio device.
+    int audio;
+
+    // Number of output channels, each with its own output gate. 
+    // The first is named "output", and the rest "output1", 
+    // "output2" and so on. 0 is treated as 1.
+    uint32_t channels;
+} gensyn_create_options_t;
+
+
+// Sets the options to the defaults, which turn everything on
+// and give a single channel.
+void gensyn_create_options_init(gensyn_create_options_t *);
+
+
+
+// Creates a context with the default options.
 gensyn_t * gensyn_create();
 
+// Creates a context with the given options. If options is NULL,
+// the defaults are used. The scripting engine is only started 
+// once the first command is sent, so a context that is only 
+// driven from C starts quickly.
+gensyn_t * gensyn_create_with_options(const gensyn_create_options_t *);
+
 
-// starts audio output to the default device.
+// Creates a context for offline rendering only, with all options 
+// turned off. There is no system instance, so gensyn_get_system 
+// returns NULL. Separate headless contexts can be used from 
+// separate threads at the same time.
+gensyn_t * gensyn_create_headless();
+
+
+// Destroys a context along with all of its gates.
+// The input loop is stopped first. Audio must not have been started,
+// and the system instance is not released.
+void gensyn_destroy(gensyn_t *);
+
+
+// starts audio output to the default device. Does nothing for headless contexts.
 void gensyn_start_audio(gensyn_t *);
 
+// starts audio output with the given device options. If options is NULL,
+// the defaults are used. If the options give no channel count, the 
+// device gets one channel for each of the context's. A mono context
+// plays on every device channel; otherwise, device channels without 
+// an output gate are silent. Does nothing for headless contexts.
+// See gensyn_system_get_audio_info for the latency that was set up
+// and how many xruns there have been.
+void gensyn_start_audio_with_options(gensyn_t *, const gensyn_system_audio_options_t *);
 
-// Gets the main output gate.
+
+// Gets the main output gate, which is the output gate of the first channel.
 gensyn_gate_t * gensyn_get_output_gate(const gensyn_t *);
 
+// Returns the number of output channels.
+uint32_t gensyn_get_channel_count(const gensyn_t *);
+
+// Gets the output gate of the given channel, or NULL if there is no such channel.
+gensyn_gate_t * gensyn_get_channel_output_gate(const gensyn_t *, uint32_t channel);
+
 
 
 
@@ -49,14 +113,35 @@ gensyn_gate_t * gensyn_get_named_gate(const gensyn_t *, const gensyn_string_t *)
 
 
 // Destroys and cleans up a named gate. This should only be used for named gates.
+// The gate is disconnected right away, but only freed once the audio 
+// thread and the input thread can no longer be using it.
 void gensyn_destroy_named_gate(const gensyn_t *, const gensyn_string_t *);
 
 
+// Marks the circuit as changed, so that it is compiled again the next
+// time it is published. Normally, this is run and controlled for you 
+// when gates are connected or removed.
+void gensyn_mark_circuit_changed(gensyn_t *);
+
+// Compiles the circuit, if it has changed, and hands it to the thread 
+// generating the waveform, which switches to it at the start of its 
+// next block. Until then, it keeps running the circuit as it was, so 
+// edits between publishes are heard all at once. Also frees the gates 
+// destroyed since, once nothing is running them anymore.
+//
+// Commands publish once they are done, as does generating a waveform
+// by hand. Circuits edited from C while audio is running must be 
+// published with this. Must be called from the thread that edits 
+// the circuit.
+void gensyn_publish_circuit(gensyn_t *);
+
+
 
 // generates a wave form, usking the output gate as the 
 // result of the end form. This will use all gates connected to the "circuit"
 // generated by the chained connections that stem from 
-// this output gate.
+// this output gate. The circuit is published first. Must not be 
+// used once audio has been started.
 void gensyn_generate_waveform(
     gensyn_t *, 
     gensyn_sample_t *   samplesOut,
@@ -64,6 +149,27 @@ void gensyn_generate_waveform(
     float               sampleRate
 );
 
+// generates the waveform of every channel at once. channelsOut 
+// holds one buffer for each channel, in channel order. Channels 
+// with a NULL buffer are still generated, so that every channel 
+// stays in step. gensyn_generate_waveform is the same with only
+// the first channel's buffer given.
+void gensyn_generate_waveform_planar(
+    gensyn_t *, 
+    gensyn_sample_t **  channelsOut,
+    uint32_t            sampleCount,
+    float               sampleRate
+);
+
+
+
+// Sets the number of worker threads used to run independent 
+// gates of the circuit in parallel with the audio thread.
+// The default is 0, which runs every gate on the audio thread.
+// The generated waveform does not depend on the worker count.
+// Takes effect once the circuit is next published.
+void gensyn_set_worker_count(gensyn_t *, uint32_t);
+
 
 
 // Sets the origin for the rendered scene.
@@ -78,4 +184,7 @@ int gensyn_get_framebuffer_texture(gensyn_t *);
 // returns a pointer to the system instance for this gensyn context.
 gensyn_system_t * gensyn_get_system(gensyn_t *);
 
+// Returns the gate types registered with this context.
+gensyn_gate_registry_t * gensyn_get_gate_registry(const gensyn_t *);
+
 #endif
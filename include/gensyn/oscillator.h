@@ -0,0 +1,73 @@
+#ifndef H_GENSYN_OSCILLATOR__INCLUDED
+#define H_GENSYN_OSCILLATOR__INCLUDED
+
+#include <gensyn/sample.h>
+
+/*
+    GenSyn: Oscillator
+
+    Shared oscillator core for gates that produce periodic waves.
+    Each oscillator keeps a 32-bit phase accumulator where one full
+    cycle is 2^32, so the phase wraps for free and stays exact no
+    matter how long the oscillator runs.
+
+    Samples are read from precomputed wavetables with linear
+    interpolation. Shapes other than the sine have a set of tables,
+    one per octave, with the harmonics above the Nyquist frequency
+    removed, so that high notes do not alias.
+
+    The oscillator is a plain struct so that gates can keep
+    one in their own data without another allocation.
+
+*/
+
+
+typedef enum {
+    GENSYN_OSCILLATOR__SHAPE__SINE,
+    GENSYN_OSCILLATOR__SHAPE__SAW,
+    GENSYN_OSCILLATOR__SHAPE__SQUARE,
+    GENSYN_OSCILLATOR__SHAPE__TRIANGLE,
+} gensyn_oscillator__shape_e;
+
+
+typedef struct {
+    // the current phase. 2^32 is one full cycle.
+    uint32_t phase;
+
+    gensyn_oscillator__shape_e shape;
+} gensyn_oscillator_t;
+
+
+
+// Sets up an oscillator with the given shape at phase 0.
+// The wavetables for the shape are built the first time
+// any oscillator of that shape is set up.
+void gensyn_oscillator_init(gensyn_oscillator_t *, gensyn_oscillator__shape_e);
+
+
+// Generates samples at a fixed frequency in Hz.
+// The output is in [-1, 1].
+void gensyn_oscillator_run(
+    gensyn_oscillator_t *,
+    gensyn_sample_t * samplesOut,
+    uint32_t sampleCount,
+    float hz,
+    float sampleRate
+);
+
+
+// Generates samples with a frequency in Hz for each sample.
+// phase, if not NULL, offsets each sample by the given
+// fraction of a cycle without affecting the running phase.
+// samplesOut may be the same buffer as hz.
+void gensyn_oscillator_run_modulated(
+    gensyn_oscillator_t *,
+    gensyn_sample_t * samplesOut,
+    const gensyn_sample_t * hz,
+    const gensyn_sample_t * phase,
+    uint32_t sampleCount,
+    float sampleRate
+);
+
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef H_GENSYNDC__POOL__INCLUDED
+#define H_GENSYNDC__POOL__INCLUDED
+
+
+#include <stdint.h>
+
+/*
+
+    Pool
+    -----
+
+    A fixed set of worker threads that run batches of 
+    independent tasks. Each batch is split evenly between 
+    the workers and the calling thread. Once a worker runs 
+    out of its own tasks, it steals tasks from the others 
+    so that uneven batches still finish together.
+
+    The workers take on the scheduling policy and priority
+    of the thread that runs the batch, so a realtime audio 
+    thread gets realtime workers.
+
+*/
+typedef struct gensyn_pool_t gensyn_pool_t;
+
+
+
+/// Creates a new pool with the given number of worker threads.
+/// The thread that calls gensyn_pool_run also works on each batch,
+/// so a pool with 0 workers simply runs the tasks in order.
+gensyn_pool_t * gensyn_pool_create(uint32_t workerCount);
+
+/// Stops all the workers and destroys the pool.
+/// The pool must not be running a batch.
+void gensyn_pool_destroy(gensyn_pool_t *);
+
+/// Returns the number of worker threads in the pool.
+uint32_t gensyn_pool_get_worker_count(const gensyn_pool_t *);
+
+/// Runs task(userData, index) for every index in [0, count) and 
+/// returns once all of them are finished. Tasks may run in 
+/// any order and on any thread, so they must not depend on 
+/// each other.
+void gensyn_pool_run(
+    gensyn_pool_t *, 
+    uint32_t count,
+    void (*task)(void * userData, uint32_t index),
+    void * userData
+);
+
+
+#endif
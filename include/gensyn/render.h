@@ -0,0 +1,108 @@
+#ifndef H_GENSYN_RENDER__INCLUDED
+#define H_GENSYN_RENDER__INCLUDED
+
+#include <gensyn/gensyn.h>
+
+/*
+    GenSyn: Render
+
+    Offline rendering of the output gates to a WAV file.
+    Rendering does not wait on an audio device, so it runs as
+    fast as the circuit can be generated. Samples are converted
+    and written out in large chunks as they are generated, so
+    long renders do not need to fit in memory.
+
+*/
+
+
+typedef enum {
+    // 32-bit float samples in [-1, 1]
+    GENSYN_RENDER__FORMAT__FLOAT32,
+
+    // 16-bit signed integer samples
+    GENSYN_RENDER__FORMAT__PCM16,
+
+    // 24-bit signed integer samples
+    GENSYN_RENDER__FORMAT__PCM24,
+} gensyn_render__format_e;
+
+
+typedef struct {
+    // samples per second.
+    float sampleRate;
+
+    // number of samples generated per gensyn_generate_waveform call.
+    // Gates see the same block sizes as they would from an
+    // audio device with the same period.
+    uint32_t blockSize;
+
+    // length of the output in seconds.
+    double duration;
+
+    // sample format of the file.
+    gensyn_render__format_e format;
+} gensyn_render_options_t;
+
+
+typedef struct {
+    // number of samples written for each channel
+    uint64_t sampleCount;
+
+    // wall-clock time spent rendering, in seconds.
+    double seconds;
+
+    // how many times faster than real time the render ran.
+    double speed;
+} gensyn_render_stats_t;
+
+
+
+// Sets the options to the defaults: 44.1 kHz, 256-sample
+// blocks, 10 seconds and 32-bit float samples.
+void gensyn_render_options_init(gensyn_render_options_t *);
+
+
+// Renders every channel of the context to a WAV file at the given path.
+// Channels are generated separately and interleaved as they are written.
+// If options is NULL, the defaults are used. If stats is not NULL,
+// it is filled with the size and speed of the render.
+// Returns 0 if the file could not be written.
+int gensyn_render_to_file(
+    gensyn_t *,
+    const char * path,
+    const gensyn_render_options_t * options,
+    gensyn_render_stats_t * stats
+);
+
+
+
+// A patch to render with gensyn_render_batch.
+typedef struct {
+    // ECMA script run on a new context to build the patch.
+    const char * script;
+
+    // file to render the patch to.
+    const char * path;
+
+    // set by the render. 1 if the file was written, 0 if not.
+    int result;
+
+    // set by the render.
+    gensyn_render_stats_t stats;
+} gensyn_render_job_t;
+
+
+// Renders each job to its file with its own headless context, so jobs 
+// cannot affect each other. Up to threadCount jobs run at once, 
+// including one on the calling thread, which returns once all jobs 
+// are done. If options is NULL, the defaults are used for every job.
+// Returns the number of files written.
+uint32_t gensyn_render_batch(
+    gensyn_render_job_t * jobs,
+    uint32_t jobCount,
+    const gensyn_render_options_t * options,
+    uint32_t threadCount
+);
+
+
+#endif
@@ -9,36 +9,83 @@
     RingBuffer
     -----
 
-    Statically sized buffer which can be used 
-    to communicate between multiple threads
-    
+    Statically sized buffer which can be used
+    to communicate between two threads.
+
+    Exactly one thread may write (push, reserve, commit)
+    and exactly one thread may read (pop, peek, release)
+    at a time. Neither side ever blocks or locks:
+    everything written before a push or commit is visible
+    to the reader once it sees the new elements.
+
 
 */
 typedef struct gensyn_ring_t gensyn_ring_t;
 
 
 
-/// Returns a new, empty array 
+/// Returns a new, empty ring
 ///
-/// sizeofType refers to the size of the elements that the array will hold 
-/// the most convenient way to do this is to use "sizeof()"
+/// sizeofType refers to the size of the elements that the ring will hold
+/// the most convenient way to do this is to use "sizeof()".
+/// The ring holds at least count elements.
 gensyn_ring_t * gensyn_ring_create(uint32_t sizeofType, uint32_t count);
 
 /// Destroys the container and buffer that it manages.
 ///
 void gensyn_ring_destroy(gensyn_ring_t *);
 
+// Returns the number of elements the ring can hold.
+uint32_t gensyn_ring_get_capacity(const gensyn_ring_t *);
+
 // returns whether there is data pending to be read
 int gensyn_ring_has_pending(const gensyn_ring_t *);
 
+// Returns the number of elements waiting to be read.
+// If called from the writer, the true count may only be lower.
+// If called from the reader, the true count may only be higher.
+uint32_t gensyn_ring_get_pending_count(const gensyn_ring_t *);
+
 
-// pushes new data.
+
+
+// pushes new data. Returns 0 if the ring is full.
 int gensyn_ring_push_p(gensyn_ring_t *, const void * p);
-#define gensyn_ring_push(__G__, __P__) (gensyn_ring_push_p(__G__, &(__P__)));
+#define gensyn_ring_push(__G__, __P__) (gensyn_ring_push_p(__G__, &(__P__)))
+
+// Pushes up to count elements from p. Returns the number pushed.
+uint32_t gensyn_ring_push_n(gensyn_ring_t *, const void * p, uint32_t count);
+
+// Gets space to write elements in place. Returns a pointer to
+// the space and sets available to the number of elements that
+// can be written there, which is at most count.
+// The space is only ever contiguous, so fewer than count elements
+// may be available even if the ring has room for more.
+// Returns NULL if the ring is full.
+void * gensyn_ring_reserve(gensyn_ring_t *, uint32_t count, uint32_t * available);
+
+// Makes count elements written to the reserved space
+// available to the reader.
+void gensyn_ring_commit(gensyn_ring_t *, uint32_t count);
+
+
+
+
+// Pops the oldest element into p. Returns 0 if there was nothing to pop.
+int gensyn_ring_pop_p(gensyn_ring_t *, void * p);
+#define gensyn_ring_pop(__G__, __P__) (gensyn_ring_pop_p(__G__, &(__P__)))
+
+// Pops up to count elements into p. Returns the number popped.
+uint32_t gensyn_ring_pop_n(gensyn_ring_t *, void * p, uint32_t count);
+
+// Reads elements in place. Returns a pointer to the oldest
+// element and sets available to the number of contiguous elements
+// that can be read from there. Returns NULL if the ring is empty.
+// The elements stay in the ring until they are released.
+const void * gensyn_ring_peek(gensyn_ring_t *, uint32_t * available);
 
-// can only pop when has_pending returns 1
-const void * gensyn_ring_pop_p(gensyn_ring_t *);
-#define gensyn_ring_pop(__G__, __T__) (*((__T__*)gensyn_ring_pop_p(__G__)));
+// Removes the count oldest elements, as returned by gensyn_ring_peek.
+void gensyn_ring_release(gensyn_ring_t *, uint32_t count);
 
 
 #endif
@@ -68,7 +68,8 @@ void gensyn_string_destroy(gensyn_string_t *);
 /// Returns a temporary string built from the given cstring 
 /// It is meant as a convenience function, but it has the following 
 /// restrictions:
-///     - This must only be used on the main thread. It is not thread-safe
+///     - Each thread has its own set of temporaries, so the string 
+///       must not be passed to other threads.
 ///     - The reference fizzles after subsequent calls to this function. 
 ///       The string must only be used for quick operations. 
 ///
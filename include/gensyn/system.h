@@ -58,6 +58,10 @@ typedef struct {
     uint8_t inputData1;
     uint8_t inputData2;
     
+    // when the event was captured, in nanoseconds 
+    // as from gensyn_system_get_time.
+    uint64_t time;
+    
 } gensyn_system__input_event_t;
 
 
@@ -82,10 +86,21 @@ int gensyn_system_input_get_device_info(
 int gensyn_system_input_query_devices(gensyn_system_t *);
 
 // Poles and processes input from the user. This includes 
-// midi events
+// midi events. Reads everything the devices have ready 
+// without waiting.
 void gensyn_system_input_update(gensyn_system_t *);
 
 
+// Blocks until a device has input ready, gensyn_system_input_wake 
+// is called or timeoutMS milliseconds pass. A timeout of -1 waits 
+// without limit. Returns 0 if the timeout passed.
+int gensyn_system_input_wait(gensyn_system_t *, int timeoutMS);
+
+// Ends a current or the next gensyn_system_input_wait early. 
+// May be called from any thread.
+void gensyn_system_input_wake(gensyn_system_t *);
+
+
 // Returns how many events are remaining after 
 // calling this function
 int gensyn_system_input_get_events(gensyn_system_t *,
@@ -95,8 +110,9 @@ int gensyn_system_input_get_events(gensyn_system_t *,
 );
 
 
-// Sends an input event onto the queue.
-// Useful for simulating events externally
+// Sends an input event onto the queue and wakes any waiting input.
+// Useful for simulating events externally. May be called from any thread.
+// If the event's time is 0, it is stamped with the current time.
 void gensyn_system_input_send_event(gensyn_system_t *, const gensyn_system__input_event_t *);
 
 
@@ -126,22 +142,145 @@ void gensyn_system_update_screen(gensyn_system_t *);
 /////////////////
 
 
+typedef enum {
+    // 32-bit float samples in [-1, 1]
+    GENSYN_SYSTEM__AUDIO_FORMAT__FLOAT32,
+
+    // 16-bit signed integer samples
+    GENSYN_SYSTEM__AUDIO_FORMAT__PCM16,
+
+    // 32-bit signed integer samples
+    GENSYN_SYSTEM__AUDIO_FORMAT__PCM32,
+} gensyn_system__audio_format_e;
+
+
+// What to ask of the audio device. The device may not support 
+// exactly what is asked, in which case the nearest it does 
+// support is used. See gensyn_system_get_audio_info for what 
+// was actually set up.
+typedef struct {
+    // name of the device to open, such as "default" or "hw:0,0".
+    const char * device;
+
+    // samples per second.
+    uint32_t sampleRate;
+
+    // number of output channels. The stream callback generates
+    // each one into its own buffer, and they are interleaved once 
+    // on the way to the device.
+    uint32_t channels;
+
+    // samples generated per call to the stream callback.
+    uint32_t periodSize;
+
+    // number of periods the device buffers. With periodSize,
+    // this sets the output latency. 2 is the lowest that 
+    // works with most devices.
+    uint32_t periodCount;
+
+    // sample format sent to the device. If the device does not 
+    // support it, the other formats are tried.
+    gensyn_system__audio_format_e format;
+
+    // If not 0, the audio thread asks for SCHED_FIFO at this 
+    // priority, from 1 to 99. This usually needs the rtprio limit 
+    // or CAP_SYS_NICE; without them, the thread keeps its 
+    // normal priority.
+    int realtimePriority;
+
+    // Whether to lock all of the process's memory into RAM, 
+    // so that the audio thread never waits on a page fault.
+    int lockMemory;
+
+    // Whether to generate samples straight into the device's 
+    // buffer (mmap access) rather than copying them in after.
+    // If the device does not support it, samples are copied.
+    int mmap;
+
+    // If not 0, samples are generated on a thread of their own, up 
+    // to this many periods ahead of the device, and the audio thread 
+    // only copies them out. A block that takes longer than a period 
+    // to generate, such as one right after a large change to the 
+    // circuit, is then covered by the periods already queued. 
+    // Adds this many periods of latency.
+    uint32_t lookahead;
+} gensyn_system_audio_options_t;
+
+
+// What the audio device was actually set up with, and how it has run.
+typedef struct {
+    // whether the stream is running.
+    int running;
+
+    // negotiated with the device.
+    uint32_t sampleRate;
+    uint32_t channels;
+    uint32_t periodSize;
+    uint32_t periodCount;
+    gensyn_system__audio_format_e format;
+
+    // samples the device buffers, and how long that takes to play, 
+    // in seconds. This is the most time between a sample being 
+    // generated and it being heard, including the lookahead.
+    uint32_t bufferSize;
+    double latency;
+
+    // periods generated ahead of the device.
+    uint32_t lookahead;
+
+    // whether the realtime priority and the memory lock were granted.
+    int realtime;
+    int memoryLocked;
+
+    // whether samples are written into the device's buffer directly.
+    int mmap;
+
+    // number of times the device ran out of samples
+    // and the stream was restarted.
+    uint64_t xrunCount;
+
+    // with a lookahead, the number of times the render thread 
+    // had nothing queued and silence was played instead.
+    uint64_t lateCount;
+} gensyn_system_audio_info_t;
+
+
+// Sets the options to the defaults: the "default" device, 44.1 kHz, 
+// mono, 2 periods of 256 samples, 32-bit float samples, copied 
+// samples, no lookahead and no realtime priority or memory lock.
+void gensyn_system_audio_options_init(gensyn_system_audio_options_t *);
+
+
 // Sets up the audio stream. Once started, 
 // the stream will continuously call the stream callback
-// as the audio device needs.
+// as the audio device needs, with periodSize samples at a time
+// at the negotiated sample rate. The callback is given a separate 
+// buffer of numSamples for each channel. If options is NULL, the 
+// defaults are used. Only the first call has any effect.
 void gensyn_system_setup_audio(
     gensyn_system_t *,
-    void (*)(void * userData, gensyn_sample_t * samples, uint32_t numSamples, float sampleRate),
+    const gensyn_system_audio_options_t * options,
+    void (*)(void * userData, gensyn_sample_t ** channels, uint32_t channelCount, uint32_t numSamples, float sampleRate),
     void * userData
 );
 
 
+// Fills info with the state of the audio stream. Returns 0 if 
+// the stream has not started or could not be set up, in 
+// which case info is only partly filled.
+int gensyn_system_get_audio_info(gensyn_system_t *, gensyn_system_audio_info_t * info);
+
+
 /////////////////
 ///////////////// UTILITY
 /////////////////
 
 void gensyn_system_usleep(uint32_t);
 
+// Returns a monotonic time in nanoseconds. Only differences 
+// between times are meaningful.
+uint64_t gensyn_system_get_time();
+
 uint8_t gensyn_system_thread_create(gensyn_system_t *, void * (*)(void *), void *);
 
 void gensyn_system_thread_cancel(gensyn_system_t *, uint8_t);
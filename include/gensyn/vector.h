@@ -0,0 +1,71 @@
+#ifndef H_GENSYN_VECTOR__INCLUDED
+#define H_GENSYN_VECTOR__INCLUDED
+
+#include <gensyn/sample.h>
+
+/*
+    GenSyn: Vector
+
+    Math kernels over sample buffers for use in gate updates.
+    The implementation is chosen once at runtime from what the
+    CPU supports: AVX2, SSE2, or a plain C fallback. All versions
+    operate on each sample in the same order, so they give the same
+    results. Buffers do not need any particular alignment, and the
+    input and output buffers may be the same.
+
+*/
+
+
+typedef enum {
+    GENSYN_VECTOR__ISA__SCALAR,
+    GENSYN_VECTOR__ISA__SSE2,
+    GENSYN_VECTOR__ISA__AVX2,
+} gensyn_vector__isa_e;
+
+
+// Picks the best kernels for the CPU. This is done for you
+// when a gensyn context is created. Until then, the plain C
+// kernels are used.
+void gensyn_vector_init();
+
+// Forces a specific set of kernels. This is mostly useful for
+// comparing them. If the CPU does not support the set, 0 is
+// returned and nothing changes.
+int gensyn_vector_set_isa(gensyn_vector__isa_e);
+
+// Returns the set of kernels in use.
+gensyn_vector__isa_e gensyn_vector_get_isa();
+
+// Returns a readable name for the set of kernels.
+const char * gensyn_vector_get_isa_name(gensyn_vector__isa_e);
+
+
+
+// out[i] = value
+void gensyn_vector_fill(gensyn_sample_t * out, float value, uint32_t count);
+
+// out[i] = in[i] * scale
+void gensyn_vector_scale(gensyn_sample_t * out, const gensyn_sample_t * in, float scale, uint32_t count);
+
+// out[i] = in[i] clamped to [low, high]. NaN samples are passed through.
+void gensyn_vector_clamp(gensyn_sample_t * out, const gensyn_sample_t * in, float low, float high, uint32_t count);
+
+// out[i] += in[i]
+void gensyn_vector_mix(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count);
+
+// out[i] *= in[i]
+void gensyn_vector_multiply(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count);
+
+// out[i] += a[i] * b[i]
+void gensyn_vector_multiply_add(gensyn_sample_t * out, const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count);
+
+// Returns the highest absolute value in the buffer, or 0 if empty.
+// NaN samples are skipped.
+float gensyn_vector_peak(const gensyn_sample_t * in, uint32_t count);
+
+// out[i] = ins[0][i] * gains[0] + ... + ins[n-1][i] * gains[n-1], in one pass.
+// out must not be one of the ins.
+void gensyn_vector_sum_scaled(gensyn_sample_t * out, const gensyn_sample_t * const * ins, const float * gains, uint32_t n, uint32_t count);
+
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef H_GENSYN_VOICES__INCLUDED
+#define H_GENSYN_VOICES__INCLUDED
+
+#include <gensyn/gate.h>
+
+/*
+    GenSyn: Voices
+
+    Polyphony for a circuit. A template circuit, built from
+    ordinary gates, is cloned into a fixed number of voices when
+    the voices are created. MIDI notes are then handed out to
+    the voices, with one note per voice at a time.
+
+    Each voice is given only its own note events, which the
+    Note_Input gates within the template turn into a pitch,
+    velocity and gate signal. Voices without a note are not run,
+    so the cost follows the number of notes playing rather
+    than the number of voices.
+
+*/
+typedef struct gensyn_voices_t gensyn_voices_t;
+
+
+
+typedef enum {
+    // A new note takes the voice that has been playing the longest.
+    GENSYN_VOICES__STEAL__OLDEST,
+
+    // A new note takes the voice that was quietest last block.
+    GENSYN_VOICES__STEAL__QUIETEST,
+
+    // New notes are dropped while all voices are playing.
+    GENSYN_VOICES__STEAL__NONE,
+
+} gensyn_voices__steal_e;
+
+
+
+// Creates voiceCount copies of the circuit connected to the
+// template gate, which acts as the output of each voice. The
+// template gates themselves are not changed or used by the voices.
+// Returns NULL if the template is NULL or the count is 0.
+gensyn_voices_t * gensyn_voices_create(
+    gensyn_t *,
+    gensyn_gate_t * templateOutput,
+    uint32_t voiceCount
+);
+
+// Destroys the voices and all the gates that were cloned for them.
+void gensyn_voices_destroy(gensyn_voices_t *);
+
+// Returns the number of voices.
+uint32_t gensyn_voices_get_count(const gensyn_voices_t *);
+
+// Returns the number of voices that were run in the last block.
+uint32_t gensyn_voices_get_active_count(const gensyn_voices_t *);
+
+
+
+// Sets what happens to a note that arrives when all voices
+// are in use. The default is GENSYN_VOICES__STEAL__OLDEST.
+void gensyn_voices_set_steal(gensyn_voices_t *, gensyn_voices__steal_e);
+
+// Sets the MIDI channel to take notes from, from 1 to 16.
+// 0, the default, takes notes from every channel.
+void gensyn_voices_set_channel(gensyn_voices_t *, int channel);
+
+// Sets the longest time, in seconds, that a voice keeps running
+// after its note is released. A released voice stops sooner
+// once its output is silent. The default is 1 second.
+void gensyn_voices_set_release(gensyn_voices_t *, float seconds);
+
+
+
+// Hands out the note events to the voices, runs every voice that
+// is playing and adds their output together into buffer. If no voice
+// is playing, buffer is left as it was and the active count is 0.
+// Must be called from one thread at a time.
+void gensyn_voices_run(
+    gensyn_voices_t *,
+    const gensyn_gate_event_t * events,
+    uint32_t eventCount,
+    gensyn_sample_t * buffer,
+    uint32_t sampleCount,
+    float sampleRate
+);
+
+
+#endif
@@ -0,0 +1,102 @@
+#include <gensyn/arena.h>
+
+#include <stdlib.h>
+
+
+#define ARENA_CACHE_LINE 64
+
+// later chunks stop growing at this many times the first.
+#define ARENA_MAX_GROWTH 64
+
+
+// Freed slots hold the next free slot.
+typedef struct gensyn_arena__free_t gensyn_arena__free_t;
+struct gensyn_arena__free_t {
+    gensyn_arena__free_t * next;
+};
+
+
+struct gensyn_arena_t {
+    uint32_t slotSize;
+    uint32_t firstChunkSlots;
+
+    // slots of the newest chunk that have never been handed out.
+    uint8_t * fresh;
+    uint32_t freshCount;
+
+    // slots that were freed, most recent first, so
+    // that a new slot is likely to still be cached.
+    gensyn_arena__free_t * freed;
+
+    // every chunk, for destroying.
+    void ** chunks;
+    uint32_t chunkCount;
+    uint32_t chunkSlots;
+
+    uint32_t count;
+};
+
+
+
+gensyn_arena_t * gensyn_arena_create(uint32_t slotSize, uint32_t slotsPerChunk) {
+    gensyn_arena_t * a = calloc(1, sizeof(gensyn_arena_t));
+    if (slotSize < sizeof(gensyn_arena__free_t)) slotSize = sizeof(gensyn_arena__free_t);
+    a->slotSize = (slotSize + ARENA_CACHE_LINE-1) & ~(ARENA_CACHE_LINE-1);
+    a->firstChunkSlots = slotsPerChunk ? slotsPerChunk : 1;
+    return a;
+}
+
+void gensyn_arena_destroy(gensyn_arena_t * a) {
+    uint32_t i;
+    for(i = 0; i < a->chunkCount; ++i) {
+        free(a->chunks[i]);
+    }
+    free(a->chunks);
+    free(a);
+}
+
+uint32_t gensyn_arena_get_slot_size(const gensyn_arena_t * a) {
+    return a->slotSize;
+}
+
+uint32_t gensyn_arena_get_count(const gensyn_arena_t * a) {
+    return a->count;
+}
+
+
+void * gensyn_arena_alloc(gensyn_arena_t * a) {
+    void * out;
+    if (a->freed) {
+        out = a->freed;
+        a->freed = a->freed->next;
+        a->count++;
+        return out;
+    }
+
+    if (!a->freshCount) {
+        uint32_t slots = a->chunkSlots ? a->chunkSlots*2 : a->firstChunkSlots;
+        if (slots > a->firstChunkSlots*ARENA_MAX_GROWTH) slots = a->firstChunkSlots*ARENA_MAX_GROWTH;
+
+        uint8_t * chunk = aligned_alloc(ARENA_CACHE_LINE, (size_t)slots*a->slotSize);
+        if (!chunk) return NULL;
+        a->chunks = realloc(a->chunks, (a->chunkCount+1)*sizeof(void*));
+        a->chunks[a->chunkCount++] = chunk;
+        a->chunkSlots = slots;
+        a->fresh = chunk;
+        a->freshCount = slots;
+    }
+
+    out = a->fresh;
+    a->fresh += a->slotSize;
+    a->freshCount--;
+    a->count++;
+    return out;
+}
+
+void gensyn_arena_free(gensyn_arena_t * a, void * slot) {
+    if (!slot) return;
+    gensyn_arena__free_t * f = slot;
+    f->next = a->freed;
+    a->freed = f;
+    a->count--;
+}
@@ -144,7 +144,7 @@ void gensyn_array_push_n(gensyn_array_t * t, const void * elements, uint32_t cou
         elements, 
         count*t->sizeofType
     );
-    t->size++;
+    t->size += count;
 }
 
 
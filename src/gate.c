@@ -1,62 +1,283 @@
 #include <gensyn/gate.h>
+#include <gensyn/gensyn.h>
 #include <gensyn/table.h>
+#include <gensyn/pool.h>
+#include <gensyn/arena.h>
+#include <gensyn/vector.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
-// In the interest of speed and simplicity, we'll
-// ise a fixed maximum of INs/OUTs
-#define MAX_CX 8
-#define MAX_PARAM 32
+#include <stdatomic.h>
+#include <math.h>
+// Parameters flagged for immediate changes are kept 
+// in masks of this many bits each.
+#define PARAM_MASK_BITS 32
+#define PARAM_MASK_WORDS(__n__) (((__n__) + PARAM_MASK_BITS-1) / PARAM_MASK_BITS)
 
+// Number of scheduled parameter changes that can be waiting 
+// for a gate. Must be a power of 2.
+#define MAX_PARAM_CHANGES 32
 
+// While a parameter is ramping, the value is updated 
+// at least this often in samples, and at least 
+// PARAM_RAMP_MIN_STEPS times over shorter ramps.
+#define PARAM_RAMP_STEP 32
+#define PARAM_RAMP_MIN_STEPS 8
 
-// the base design of the gate interface allows for alterations to be made to the 
-// gate mostly safely in parallel. No allocations are necessary to modification of the 
-// gate nor in querying for the gate.
-struct gensyn_gate_t {
+// Number of events that a control-rate gate holds on to 
+// until its next period starts. Any more are dropped.
+#define CONTROL_HELD_EVENTS 32
+
+// Alignment of the buffers that plans share out, 
+// so that no buffer straddles a cache line.
+#define PLAN_BUFFER_ALIGNMENT 64
+
+// marks an unconnected input within a plan.
+#define NO_STEP UINT32_MAX
+
+// Gates of a class are packed together in chunks of the class's arena, 
+// the first holding this many. Class data in a slot is aligned to 16 bytes.
+#define GATE_ARENA_CHUNK 16
+#define GATE_SLOT_ALIGN(__n__) (((__n__) + 15) & ~(size_t)15)
+
+
+
+// A scheduled change to a parameter.
+typedef struct {
+    uint64_t sampleTick;
+    float value;
+    int handle;
+    gensyn_gate__ramp_e ramp;
+    uint32_t rampLength;
+} gensyn_gate__param_change_t;
+
+
+// A parameter that is currently ramping.
+typedef struct {
+    int handle;
+    gensyn_gate__ramp_e ramp;
+    float from;
+    float to;
+    uint64_t startTick;
+    uint32_t length;
+} gensyn_gate__param_ramp_t;
+
+
+// Parameter changes sent to a gate from another thread.
+// Each gate with parameters has one. Changes are only applied 
+// by the thread running the gate, so updates never see 
+// a parameter change partway through a block.
+//
+// Every update checks the masks, queue indices and counts, so those 
+// live in the gate's own slot, after its params. The arrays are only 
+// read when something has actually changed, so they live in one 
+// block of their own, sized for the class and starting with requested; 
+// see gensyn_gate__automation_layout.
+typedef struct {
+    // Scheduled changes, as a single-producer, single-consumer queue.
+    _Atomic uint32_t write;
+    _Atomic uint32_t read;
+
+    // Only used by the thread running the gate.
+    uint32_t pendingCount;
+    uint32_t rampCount;
+
+    // The value bits of each parameter for immediate changes.
+    _Atomic uint32_t * requested;
+
+    gensyn_gate__param_change_t * queue;
+
+    // The rest is only used by the thread running the gate.
+
+    // Changes taken from the queue that are still in the future, 
+    // sorted by sample tick. MAX_PARAM_CHANGES long, like the queue.
+    gensyn_gate__param_change_t * pending;
+
+    // at most one per parameter.
+    gensyn_gate__param_ramp_t * ramps;
+
+    // Immediate changes: which parameters have new values,
+    // PARAM_MASK_WORDS(nparams) long.
+    _Atomic uint32_t requestedMask[];
+} gensyn_gate__automation_t;
+
+
+
+
+// What a buffer is known to hold.
+typedef struct {
+    // whether every sample is value.
+    int isConstant;
+    float value;
+} gensyn_gate__buffer_state_t;
+
+
+// Everything about a gate that running it does not need: what it is 
+// called and how it is drawn, its outgoing connections, and the setup 
+// for creating and removing it. Kept apart from the gate so that the 
+// gates of a plan stay small and close together.
+typedef struct {
     gensyn_t * context;
     gensyn_string_t * type;
+    gensyn_string_t * desc;
     gensyn_gate__create_fn onCreate;
-    gensyn_gate__update_fn onUpdate;
     gensyn_gate__remove_fn onRemove;
     gensyn_gate__input_fn  onInput;
 
-    int nins;
-    int nouts;    
-    int nparams;
     int texture;
     int x;
     int y;
-    int isActive;
-    float params[MAX_PARAM];
 
-    gensyn_gate_t * inrefs [MAX_CX];
-    gensyn_gate_t * outrefs[MAX_CX];
+    // of type gensyn_gate_t *. NULL for prefabs.
+    gensyn_array_t * outrefs;
 
-    
     gensyn_array_t * innamesArr;
     gensyn_array_t * paramnamesArr;
 
-    gensyn_string_t * desc;
-    void * data;
-
+    // the gate's own buffer, used by gensyn_gate_run. Plans 
+    // give the gate one of their shared buffers instead.
     gensyn_sample_t * sampleBuffer;
     uint32_t sampleBufferSize;
-    uint32_t updateID;
+
+    // what the gate's own buffer holds.
+    gensyn_gate__buffer_state_t bufferState;
+
+    // where gates of this class and their automation live. 
+    // Owned by the prefab. automations is NULL without parameters.
+    gensyn_arena_t * arena;
+    gensyn_arena_t * automations;
+
+    // where the class's automation and data start in each slot, 
+    // and the data's size.
+    uint32_t automationOffset;
+    uint32_t dataOffset;
+    uint32_t dataSize;
+} gensyn_gate__cold_t;
+
+
+// the base design of the gate interface allows for alterations to be made to the 
+// gate mostly safely in parallel. No allocations are necessary to modification of the 
+// gate nor in querying for the gate.
+//
+// Only what running the gate touches is kept here, roughly in the order 
+// that an update reads it. The gate's slot in its class's arena continues 
+// with its inrefs, then its params, then its automation, then its class's data.
+struct gensyn_gate_t {
+    gensyn_gate__update_fn onUpdate;
+    void * data;
+
+    // NULL if the gate has no parameters.
+    gensyn_gate__automation_t * automation;
     uint64_t sampleTick;
+    uint32_t updateID;
+    uint32_t planIndex;
+
+    int nins;
+    int nparams;
+    int isActive;
+
+    // whether every sample in the buffer is known to be constantValue.
+    int isConstant;
+    float constantValue;
+
+    // given by gensyn_gate_output_constant during the update.
+    float outputValue;
+
+    // whether the gate is only updated once per GENSYN_GATE_CONTROL_PERIOD.
+    int controlRate;
+
+    // for control-rate gates: the output values that the current 
+    // period ramps between, and room for the update's inputs 
+    // followed by its output, each controlSize long.
+    float controlFrom;
+    float controlTo;
+    uint32_t controlSize;
+    gensyn_sample_t * controlBuffers;
+
+    // for control-rate gates: events from updates that had no 
+    // period start, given at the next one. CONTROL_HELD_EVENTS long.
+    gensyn_gate_event_t * controlHeld;
+    uint32_t controlHeldCount;
+
+    // nins long.
+    gensyn_gate_t ** inrefs;
+
+    // the IN gates as of the plan being run, which is what the update 
+    // sees. inrefs belongs to the thread editing the circuit and may 
+    // change at any time, so it is only read when compiling.
+    gensyn_gate_t ** runInrefs;
+
+    // nparams long.
+    float * params;
+
+    gensyn_gate__cold_t * cold;
 };
 
 
 
 
 
-static gensyn_table_t * prefabs = NULL;
+struct gensyn_gate_registry_t {
+    // registered gate types by name. Each is a prefab gate 
+    // that new gates of the type are cloned from.
+    gensyn_table_t * prefabs;
+
+    // source of IDs for runs and compiles. Gates of a 
+    // context only ever compare IDs from the same source.
+    // Voices compile their plans away from the thread that runs.
+    _Atomic uint32_t updatePool;
+
+    // cold records for the gates of all classes, 
+    // kept away from the gates since they are rarely touched.
+    gensyn_arena_t * colds;
+};
+
 
 // Clones a prefab gate to make a new real gate.
-static gensyn_gate_t * gensyn_gate_clone(const gensyn_gate_t *);
+static gensyn_gate_t * gensyn_gate_clone(gensyn_gate_registry_t *, const gensyn_gate_t *);
+
+// Destroys a prefab gate along with the names that its clones share.
+static void gensyn_gate__prefab_destroy(gensyn_gate_t *);
+
+// Adds a named IN or parameter to a prefab gate.
+// Returns 0 if the name is already taken.
+static int gensyn_gate__add_in(gensyn_gate_t *, const gensyn_string_t *);
+static int gensyn_gate__add_param(gensyn_gate_t *, const gensyn_string_t *, float);
+
+// Returns the size of the block for the arrays of the automation for the 
+// number of parameters. If given automation and a block, also clears 
+// both and points the automation's arrays into the block.
+static uint32_t gensyn_gate__automation_layout(gensyn_gate__automation_t *, void * block, int nparams);
+
+// Returns the next run or compile ID for the gate's context.
+static uint32_t gensyn_gate__next_update_id(gensyn_gate_t *);
+
+
+
+gensyn_gate_registry_t * gensyn_gate_registry_create() {
+    gensyn_gate_registry_t * r = calloc(1, sizeof(gensyn_gate_registry_t));
+    r->prefabs = gensyn_table_create_hash_gensyn_string();
+    r->updatePool = 0xff;
+    r->colds = gensyn_arena_create(sizeof(gensyn_gate__cold_t), GATE_ARENA_CHUNK);
+    return r;
+}
+
+void gensyn_gate_registry_destroy(gensyn_gate_registry_t * r) {
+    gensyn_table_iter_t * iter = gensyn_table_iter_create();
+    for( gensyn_table_iter_start(iter, r->prefabs);
+        !gensyn_table_iter_is_end(iter);
+         gensyn_table_iter_proceed(iter)) {
+        gensyn_gate__prefab_destroy(gensyn_table_iter_get_value(iter));
+    }
+    gensyn_table_iter_destroy(iter);
+    gensyn_table_destroy(r->prefabs);
+    gensyn_arena_destroy(r->colds);
+    free(r);
+}
 
 
 int gensyn_gate_register(
+    gensyn_t *                  context,
     
     const gensyn_string_t *     name,
     const gensyn_string_t *     desc,
@@ -68,89 +289,108 @@ int gensyn_gate_register(
     
     ...
 ) {
-    if (!prefabs) {
-        prefabs = gensyn_table_create_hash_gensyn_string();
-    } else {
+    gensyn_table_t * prefabs = gensyn_get_gate_registry(context)->prefabs;
 
-        // already registered.
-        if (gensyn_table_entry_exists(prefabs, name)) {
-            return 0;
-        }
+    // already registered.
+    if (gensyn_table_entry_exists(prefabs, name)) {
+        return 0;
     }
 
     va_list args;
     va_start(args, onInput);
 
     gensyn_gate_t * g = calloc(1, sizeof(gensyn_gate_t));
+    gensyn_gate__cold_t * cold = calloc(1, sizeof(gensyn_gate__cold_t));
+    g->cold = cold;
 
-    g->onCreate = onCreate;
     g->onUpdate = onUpdate;
-    g->onRemove = onRemove;
-    g->onInput  = onInput;
-    g->desc = gensyn_string_clone(desc);
-    g->texture = texID;
-    g->type = gensyn_string_clone(name);
-    g->innamesArr = gensyn_array_create(sizeof(gensyn_string_t*));
-    g->paramnamesArr = gensyn_array_create(sizeof(gensyn_string_t*));
+    cold->onCreate = onCreate;
+    cold->onRemove = onRemove;
+    cold->onInput  = onInput;
+    cold->desc = gensyn_string_clone(desc);
+    cold->texture = texID;
+    cold->type = gensyn_string_clone(name);
+    cold->innamesArr = gensyn_array_create(sizeof(gensyn_string_t*));
+    cold->paramnamesArr = gensyn_array_create(sizeof(gensyn_string_t*));
     
     
-    int i;
-    gensyn_string_t * entry;
+    int i, count;
+    const gensyn_string_t * entry;
+    gensyn_string_t * numbered;
     float dfparam;
 L_START:
     switch(va_arg(args, gensyn_gate__property_e)) {
       case GENSYN_GATE__PROPERTY__CONNECTION:
         entry = va_arg(args, gensyn_string_t*);
-        
-        // max reached. error in registration
-        if (g->nins >= MAX_CX) {
-            gensyn_gate_destroy(g);
-            return 0;                            
-        }
-
         // already exists with this name. Error in registration
-        for(i = 0; i < g->nins; ++i) {
-            if (gensyn_string_test_eq(gensyn_array_at(g->innamesArr, gensyn_string_t *, i), entry)) {
-                gensyn_gate_destroy(g);
-                return 0;                                            
-            }
-        }            
-        entry = gensyn_string_clone(entry);
-        gensyn_array_push(g->innamesArr, entry);
-        g->nins++;
+        if (!gensyn_gate__add_in(g, entry)) goto L_FAIL;
         break;
             
+      case GENSYN_GATE__PROPERTY__CONNECTION_ARRAY:
+        entry = va_arg(args, gensyn_string_t*);
+        count = va_arg(args, int);
+        for(i = 0; i < count; ++i) {
+            numbered = gensyn_string_create_from_c_str("%s%d", gensyn_string_get_c_str(entry), i);
+            int added = gensyn_gate__add_in(g, numbered);
+            gensyn_string_destroy(numbered);
+            if (!added) goto L_FAIL;
+        }
+        break;
 
       case GENSYN_GATE__PROPERTY__PARAM:
         entry = va_arg(args, gensyn_string_t*);
         dfparam = va_arg(args, double);        
-        // max reached. error in registration
-        if (g->nparams >= MAX_PARAM) {
-            gensyn_gate_destroy(g);
-            return 0;                            
-        }
+        if (!gensyn_gate__add_param(g, entry, dfparam)) goto L_FAIL;
+        break;
 
-        // already exists with this name. Error in registration
-        for(i = 0; i < g->nouts; ++i) {
-            if (gensyn_string_test_eq(gensyn_array_at(g->paramnamesArr, gensyn_string_t *, i), entry)) {
-                gensyn_gate_destroy(g);
-                return 0;                                            
-            }
-        }            
-        entry = gensyn_string_clone(entry);
-        gensyn_array_push(g->paramnamesArr, entry);
-        g->params[g->nparams++] = dfparam;      
+      case GENSYN_GATE__PROPERTY__PARAM_ARRAY:
+        entry = va_arg(args, gensyn_string_t*);
+        count = va_arg(args, int);
+        dfparam = va_arg(args, double);
+        for(i = 0; i < count; ++i) {
+            numbered = gensyn_string_create_from_c_str("%s%d", gensyn_string_get_c_str(entry), i);
+            int added = gensyn_gate__add_param(g, numbered, dfparam);
+            gensyn_string_destroy(numbered);
+            if (!added) goto L_FAIL;
+        }
         break;
       
+      case GENSYN_GATE__PROPERTY__CONTROL_RATE:
+        g->controlRate = 1;
+        break;
+
+      case GENSYN_GATE__PROPERTY__DATA_SIZE:
+        cold->dataSize = va_arg(args, size_t);
+        break;
+
       case GENSYN_GATE__PROPERTY__END:
         goto L_END;
     }    
     goto L_START;
 
 L_END:
+    cold->automationOffset = GATE_SLOT_ALIGN(
+        sizeof(gensyn_gate_t) + 
+        g->nins*sizeof(gensyn_gate_t *) + 
+        g->nparams*sizeof(float)
+    );
+    cold->dataOffset = cold->automationOffset;
+    if (g->nparams) {
+        cold->dataOffset += GATE_SLOT_ALIGN(
+            sizeof(gensyn_gate__automation_t) + 
+            PARAM_MASK_WORDS(g->nparams)*sizeof(uint32_t)
+        );
+        cold->automations = gensyn_arena_create(gensyn_gate__automation_layout(NULL, NULL, g->nparams), GATE_ARENA_CHUNK);
+    }
+    cold->arena = gensyn_arena_create(cold->dataOffset + cold->dataSize, GATE_ARENA_CHUNK);
     gensyn_table_insert(prefabs, name, g);    
     va_end(args);
     return 1;
+
+L_FAIL:
+    gensyn_gate__prefab_destroy(g);
+    va_end(args);
+    return 0;
 }
 
 
@@ -162,45 +402,464 @@ uint64_t gensyn_gate_get_sample_tick(const gensyn_gate_t * g) {
 
 
 gensyn_gate_t * gensyn_gate_create(gensyn_t * ctx, const gensyn_string_t * str) {
-    gensyn_gate_t * prefab = gensyn_table_find(prefabs, str);
+    gensyn_gate_t * prefab = gensyn_table_find(gensyn_get_gate_registry(ctx)->prefabs, str);
     if (!prefab) return NULL;
 
-    gensyn_gate_t * out = gensyn_gate_clone(prefab);
-    out->context = ctx;
-    out->data = out->onCreate(out);
+    gensyn_gate_registry_t * r = gensyn_get_gate_registry(ctx);
+    gensyn_gate_t * out = gensyn_gate_clone(r, prefab);
+    out->cold->context = ctx;
+    if (out->nparams) {
+        out->automation = (gensyn_gate__automation_t *)((uint8_t*)out + out->cold->automationOffset);
+        gensyn_gate__automation_layout(out->automation, gensyn_arena_alloc(out->cold->automations), out->nparams);
+    }
+    if (out->cold->dataSize) {
+        out->data = (uint8_t*)out + out->cold->dataOffset;
+        memset(out->data, 0, out->cold->dataSize);
+    }
+    out->data = out->cold->onCreate(out);
     return out;
 }
 
 
 void gensyn_gate_destroy(gensyn_gate_t * g) {
+    gensyn_gate__cold_t * cold = g->cold;
+    gensyn_gate_registry_t * r = gensyn_get_gate_registry(cold->context);
+    cold->onRemove(g, g->data);
+    gensyn_gate_disconnect_all(g);
+
+    if (g->automation) gensyn_arena_free(cold->automations, (void*)g->automation->requested);
+    gensyn_array_destroy(cold->outrefs);
+    free(cold->sampleBuffer);
+    free(g->controlBuffers);
+    free(g->controlHeld);
+    gensyn_arena_free(cold->arena, g);
+    gensyn_arena_free(r->colds, cold);
+}
+
+
+void gensyn_gate_disconnect_all(gensyn_gate_t * g) {
+    gensyn_gate__cold_t * cold = g->cold;
     int i, n;
-    g->onRemove(g, g->data);
 
+    // disconnect the gates feeding into this one
     for(i = 0; i < g->nins; ++i) {
         if (g->inrefs[i]) {
-            for(n = 0; n < g->inrefs[i]->nouts; ++n) {
-                if (g->inrefs[i]->outrefs[i] == g) {
-                    g->inrefs[i]->outrefs[i] = NULL;
-                    break;
-                }
+            gensyn_gate_connect(NULL, gensyn_array_at(cold->innamesArr, gensyn_string_t *, i), g);
+        }
+    }
+
+    // and the gates this one feeds into
+    for(i = 0; i < gensyn_array_get_size(cold->outrefs); ++i) {
+        gensyn_gate_t * out = gensyn_array_at(cold->outrefs, gensyn_gate_t *, i);
+        for(n = 0; n < out->nins; ++n) {
+            if (out->inrefs[n] == g) {
+                out->inrefs[n] = NULL;
             }
         }
     }
-    for(i = 0; i < g->nouts; ++i) {
-        if (g->outrefs[i]) {
-            for(n = 0; n < g->outrefs[i]->nouts; ++n) {
-                if (g->outrefs[i]->inrefs[i] == g) {
-                    g->outrefs[i]->inrefs[i] = NULL;
-                    break;
-                }
+    if (gensyn_array_get_size(cold->outrefs) && cold->context) {
+        gensyn_mark_circuit_changed(cold->context);
+    }
+    gensyn_array_clear(cold->outrefs);
+}
+
+
+
+
+// Returns the value of a ramp at the given tick.
+static float gensyn_gate__ramp_value(const gensyn_gate__param_ramp_t * r, uint64_t tick) {
+    if (tick <= r->startTick) return r->from;
+    if (tick >= r->startTick + r->length) return r->to;
+    float t = (tick - r->startTick) / (float)r->length;
+    if (r->ramp == GENSYN_GATE__RAMP__EXPONENTIAL && r->from * r->to > 0) {
+        return r->from * powf(r->to / r->from, t);
+    }
+    return r->from + (r->to - r->from)*t;
+}
+
+
+// Moves all changes from the queue into the pending list.
+static void gensyn_gate__automation_receive(gensyn_gate__automation_t * a) {
+    uint32_t read  = atomic_load_explicit(&a->read,  memory_order_relaxed);
+    uint32_t write = atomic_load_explicit(&a->write, memory_order_acquire);
+    for(; read != write && a->pendingCount < MAX_PARAM_CHANGES; ++read) {
+        gensyn_gate__param_change_t * c = a->queue + (read % MAX_PARAM_CHANGES);
+
+        // keep sorted, with changes for the same tick in the order they were sent.
+        uint32_t i = a->pendingCount;
+        while(i && a->pending[i-1].sampleTick > c->sampleTick) {
+            a->pending[i] = a->pending[i-1];
+            i--;
+        }
+        a->pending[i] = *c;
+        a->pendingCount++;
+    }
+    atomic_store_explicit(&a->read, read, memory_order_release);
+}
+
+
+// Applies a change that has been reached.
+static void gensyn_gate__automation_apply(
+    gensyn_gate_t * g, 
+    const gensyn_gate__param_change_t * c, 
+    uint64_t tick
+) {
+    gensyn_gate__automation_t * a = g->automation;
+    uint32_t i;
+    for(i = 0; i < a->rampCount; ++i) {
+        if (a->ramps[i].handle == c->handle) {
+            g->params[c->handle] = gensyn_gate__ramp_value(a->ramps+i, tick);
+            a->ramps[i] = a->ramps[--a->rampCount];
+            break;
+        }
+    }
+
+    if (c->ramp == GENSYN_GATE__RAMP__NONE || !c->rampLength) {
+        g->params[c->handle] = c->value;
+        return;
+    }
+
+    gensyn_gate__param_ramp_t * r = a->ramps + a->rampCount++;
+    r->handle    = c->handle;
+    r->ramp      = c->ramp;
+    r->from      = g->params[c->handle];
+    r->to        = c->value;
+    r->startTick = tick;
+    r->length    = c->rampLength;
+}
+
+
+// Applies everything due at the given tick and returns the number 
+// of samples that can be run before the parameters change again.
+static uint32_t gensyn_gate__automation_advance(gensyn_gate_t * g, uint64_t tick, uint32_t maxCount) {
+    gensyn_gate__automation_t * a = g->automation;
+    uint32_t i;
+
+    // apply all due changes
+    for(i = 0; i < a->pendingCount && a->pending[i].sampleTick <= tick; ++i) {
+        gensyn_gate__automation_apply(g, a->pending+i, tick);
+    }
+    if (i) {
+        a->pendingCount -= i;
+        memmove(a->pending, a->pending+i, a->pendingCount*sizeof(gensyn_gate__param_change_t));
+    }
+
+    // finished ramps land on their value
+    for(i = 0; i < a->rampCount;) {
+        gensyn_gate__param_ramp_t * r = a->ramps+i;
+        if (tick >= r->startTick + r->length) {
+            g->params[r->handle] = r->to;
+            *r = a->ramps[--a->rampCount];
+        } else {
+            ++i;
+        }
+    }
+
+    uint32_t count = maxCount;
+    if (a->pendingCount && a->pending[0].sampleTick - tick < count) {
+        count = a->pending[0].sampleTick - tick;
+    }
+    for(i = 0; i < a->rampCount; ++i) {
+        gensyn_gate__param_ramp_t * r = a->ramps+i;
+        uint32_t step = r->length / PARAM_RAMP_MIN_STEPS;
+        if (step > PARAM_RAMP_STEP) step = PARAM_RAMP_STEP;
+        if (step < 1) step = 1;
+        if (step > r->startTick + r->length - tick) step = r->startTick + r->length - tick;
+        if (count > step) count = step;
+    }
+
+    // each step holds the value due at its end, so a ramp moves 
+    // from its first step and reaches its value as it finishes.
+    for(i = 0; i < a->rampCount; ++i) {
+        gensyn_gate__param_ramp_t * r = a->ramps+i;
+        g->params[r->handle] = gensyn_gate__ramp_value(r, tick + count);
+    }
+    return count;
+}
+
+
+// Makes sure a control-rate gate has room to update 
+// up to the given number of samples at once.
+static void gensyn_gate__reserve_control(gensyn_gate_t * g, uint32_t sampleCount) {
+    // a part of the block can hold one more period start than a full period would.
+    uint32_t size = sampleCount / GENSYN_GATE_CONTROL_PERIOD + 1;
+    if (!g->controlRate) return;
+    if (!g->controlHeld) {
+        g->controlHeld = calloc(CONTROL_HELD_EVENTS, sizeof(gensyn_gate_event_t));
+    }
+    if (g->controlSize >= size) return;
+    free(g->controlBuffers);
+    g->controlBuffers = calloc((g->nins+1)*size, sizeof(gensyn_sample_t));
+    g->controlSize = size;
+}
+
+
+// Gives the gate its own buffer for the given sample count.
+static void gensyn_gate__resize(gensyn_gate_t * g, uint32_t sampleCount) {
+    gensyn_gate__cold_t * cold = g->cold;
+    free(cold->sampleBuffer);
+    cold->sampleBuffer = calloc(sampleCount, sizeof(gensyn_sample_t));
+    cold->sampleBufferSize = sampleCount;
+    cold->bufferState.isConstant = 1;
+    cold->bufferState.value = 0.f;
+    gensyn_gate__reserve_control(g, sampleCount);
+}
+
+
+// Calls a control-rate gate's update for the next sampleCount 
+// samples of the gate, then ramps its output into buffer.
+// Periods are counted from the gate's sample tick, so they 
+// line up across blocks and parts of blocks. A part too short 
+// to hold a period start has no update, so its events are held 
+// and given first at the next period start.
+static int gensyn_gate__update_control(
+    gensyn_gate_t * g,
+    gensyn_sample_t ** inBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t eventCount,
+    gensyn_sample_t * buffer,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    const uint32_t period = GENSYN_GATE_CONTROL_PERIOD;
+    uint32_t phase = g->sampleTick % period;
+    uint32_t first = phase ? period - phase : 0;
+    uint32_t count = first < sampleCount ? (sampleCount - first + period - 1) / period : 0;
+    gensyn_sample_t * out = g->controlBuffers + g->nins*g->controlSize;
+    uint32_t i, n;
+
+    if (!count) {
+        for(i = 0; i < eventCount && g->controlHeldCount < CONTROL_HELD_EVENTS; ++i) {
+            g->controlHeld[g->controlHeldCount++] = events[i];
+        }
+    } else {
+        gensyn_sample_t * ins[g->nins ? g->nins : 1];
+        for(i = 0; i < g->nins; ++i) {
+            if (!inBuffers[i]) {
+                ins[i] = NULL;
+                continue;
+            }
+            ins[i] = g->controlBuffers + i*g->controlSize;
+            for(n = 0; n < count; ++n) {
+                ins[i][n] = inBuffers[i][first + n*period];
             }
         }
+
+        uint32_t held = g->controlHeldCount;
+        gensyn_gate_event_t controlEvents[held + eventCount ? held + eventCount : 1];
+        for(i = 0; i < held; ++i) {
+            controlEvents[i] = g->controlHeld[i];
+            controlEvents[i].offset = 0;
+        }
+        g->controlHeldCount = 0;
+        for(i = 0; i < eventCount; ++i) {
+            controlEvents[held+i] = events[i];
+            controlEvents[held+i].offset = events[i].offset < first ? 0 : (events[i].offset - first) / period;
+        }
+
+        int output = g->onUpdate(
+            g,
+            g->nins,
+            ins,
+            controlEvents,
+            held + eventCount,
+            out,
+            count,
+            sampleRate / period,
+            g->data
+        );
+        if (output != GENSYN_GATE__OUTPUT__WRITTEN) {
+            gensyn_vector_fill(out, output == GENSYN_GATE__OUTPUT__CONSTANT ? g->outputValue : 0.f, count);
+        }
     }
-    free(g);
+
+    // nothing changes across the samples.
+    int steady = !phase || g->controlFrom == g->controlTo;
+    for(n = 0; n < count && steady; ++n) {
+        steady = out[n] == g->controlTo;
+    }
+    if (steady) {
+        if (count) g->controlFrom = g->controlTo;
+        return gensyn_gate_output_constant(g, g->controlTo);
+    }
+
+    uint32_t offset = 0;
+    n = 0;
+    while(offset < sampleCount) {
+        if (!phase) {
+            g->controlFrom = g->controlTo;
+            g->controlTo = out[n++];
+        }
+        uint32_t len = period - phase;
+        if (len > sampleCount - offset) len = sampleCount - offset;
+
+        float step = (g->controlTo - g->controlFrom) / period;
+        for(i = 0; i < len; ++i) {
+            buffer[offset+i] = g->controlFrom + step*(phase+i+1);
+        }
+        offset += len;
+        phase = 0;
+    }
+    return GENSYN_GATE__OUTPUT__WRITTEN;
 }
 
 
-static uint32_t updatePool = 0xff;
+// Calls the gate's update for the next sampleCount samples of the gate.
+static int gensyn_gate__call_update(
+    gensyn_gate_t * g,
+    gensyn_sample_t ** inBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t eventCount,
+    gensyn_sample_t * buffer,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    if (g->controlRate) {
+        return gensyn_gate__update_control(g, inBuffers, events, eventCount, buffer, sampleCount, sampleRate);
+    }
+    return g->onUpdate(
+        g,
+        g->nins,
+        inBuffers,
+        events,
+        eventCount,
+        buffer,
+        sampleCount,
+        sampleRate,
+        g->data
+    );
+}
+
+
+// Updates a single gate, applying any parameter changes that 
+// are due within the block. If a change is due partway through, 
+// the block is split so that it lands on the exact sample.
+// Each part is given the events that land within it.
+static void gensyn_gate__update(
+    gensyn_gate_t * g,
+    gensyn_sample_t * buffer,
+    gensyn_gate__buffer_state_t * state,
+    gensyn_sample_t ** inBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t eventCount,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    gensyn_gate__automation_t * a = g->automation;
+    if (a) {
+        int w, words = PARAM_MASK_WORDS(g->nparams);
+        for(w = 0; w < words; ++w) {
+            // only write to the mask when something has changed.
+            if (!atomic_load_explicit(a->requestedMask+w, memory_order_relaxed)) continue;
+            uint32_t mask = atomic_exchange_explicit(a->requestedMask+w, 0, memory_order_acquire);
+            while(mask) {
+                int i = w*PARAM_MASK_BITS + __builtin_ctz(mask);
+                uint32_t bits = atomic_load_explicit(a->requested+i, memory_order_relaxed);
+                memcpy(g->params+i, &bits, sizeof(float));
+                mask &= mask-1;
+
+                // an immediate change overrides a ramp in progress.
+                uint32_t n;
+                for(n = 0; n < a->rampCount; ++n) {
+                    if (a->ramps[n].handle == i) {
+                        a->ramps[n] = a->ramps[--a->rampCount];
+                        break;
+                    }
+                }
+            }
+        }
+        if (atomic_load_explicit(&a->write, memory_order_relaxed) != 
+            atomic_load_explicit(&a->read,  memory_order_relaxed)) {
+            gensyn_gate__automation_receive(a);
+        }
+    }
+
+    // common case: nothing is scheduled.
+    if (!a || (!a->pendingCount && !a->rampCount) || 
+        (!a->rampCount && a->pending[0].sampleTick >= g->sampleTick + sampleCount)) {
+        int output = gensyn_gate__call_update(
+            g,
+            inBuffers,
+            events,
+            eventCount,
+            buffer,
+            sampleCount,
+            sampleRate
+        );
+
+        if (output == GENSYN_GATE__OUTPUT__WRITTEN) {
+            g->isConstant = 0;
+        } else {
+            // a buffer that already holds the value is left as is, 
+            // so a steady gate costs nothing past its update.
+            float value = output == GENSYN_GATE__OUTPUT__CONSTANT ? g->outputValue : 0.f;
+            if (!state->isConstant || state->value != value) {
+                gensyn_vector_fill(buffer, value, sampleCount);
+            }
+            g->isConstant = 1;
+            g->constantValue = value;
+        }
+        state->isConstant = g->isConstant;
+        state->value = g->constantValue;
+        g->isActive = 1;
+        g->sampleTick += sampleCount;
+        return;
+    }
+
+    gensyn_sample_t * ins[g->nins ? g->nins : 1];
+    gensyn_gate_event_t partEvents[eventCount ? eventCount : 1];
+    uint32_t offset = 0;
+    uint32_t nextEvent = 0;
+    // whether every part so far has been the same constant.
+    int allConstant = 1;
+    float partsValue = 0.f;
+    int i;
+    while(offset < sampleCount) {
+        uint32_t count = gensyn_gate__automation_advance(g, g->sampleTick, sampleCount - offset);
+        for(i = 0; i < g->nins; ++i) {
+            ins[i] = inBuffers[i] ? inBuffers[i] + offset : NULL;
+        }
+
+        // events are sorted, so the ones for this part are the next few.
+        uint32_t partEventCount = 0;
+        for(; nextEvent < eventCount && events[nextEvent].offset < offset + count; ++nextEvent) {
+            partEvents[partEventCount] = events[nextEvent];
+            partEvents[partEventCount++].offset -= offset;
+        }
+
+        int output = gensyn_gate__call_update(
+            g,
+            ins,
+            partEvents,
+            partEventCount,
+            buffer + offset,
+            count,
+            sampleRate
+        );
+        if (output == GENSYN_GATE__OUTPUT__WRITTEN) {
+            allConstant = 0;
+        } else {
+            // the other parts only touch their own samples, so the buffer 
+            // still holds what it did before the block here.
+            float value = output == GENSYN_GATE__OUTPUT__CONSTANT ? g->outputValue : 0.f;
+            if (!state->isConstant || state->value != value) {
+                gensyn_vector_fill(buffer + offset, value, count);
+            }
+            if (!offset) {
+                partsValue = value;
+            } else if (value != partsValue) {
+                allConstant = 0;
+            }
+        }
+        g->sampleTick += count;
+        offset += count;
+    }
+    g->isConstant = allConstant;
+    g->constantValue = partsValue;
+    state->isConstant = allConstant;
+    state->value = partsValue;
+    g->isActive = 1;
+}
 
 void gensyn_gate_run__internal(
     gensyn_gate_t * g, 
@@ -217,12 +876,11 @@ void gensyn_gate_run__internal(
         return;
     }
     g->updateID = updateID;
+    g->runInrefs = g->inrefs;
 
     // make sure internal buffer can handle it.
-    if (g->sampleBufferSize <= sampleCount) {
-        free(g->sampleBuffer);
-        g->sampleBuffer = calloc(sampleCount, sizeof(gensyn_sample_t));
-        g->sampleBufferSize = sampleCount;
+    if (g->cold->sampleBufferSize != sampleCount) {
+        gensyn_gate__resize(g, sampleCount);
     }  
 
 
@@ -235,24 +893,14 @@ void gensyn_gate_run__internal(
                 sampleRate,
                 updateID
             );
-            inBuffers[i] = g->inrefs[i]->sampleBuffer;
+            inBuffers[i] = g->inrefs[i]->cold->sampleBuffer;
         } else {
             inBuffers[i] = NULL;
         }
     }
 
     // update local buffer
-    g->onUpdate(
-        g,
-        g->nins,
-        inBuffers,
-        g->sampleBuffer,
-        sampleCount,
-        sampleRate,
-        g->data
-    );
-    g->isActive = 1;
-    g->sampleTick += sampleCount;
+    gensyn_gate__update(g, g->cold->sampleBuffer, &g->cold->bufferState, inBuffers, NULL, 0, sampleCount, sampleRate);
 }
 
 
@@ -266,13 +914,562 @@ void gensyn_gate_run(
         g,
         sampleCount,
         sampleRate,
-        ++updatePool
+        gensyn_gate__next_update_id(g)
     );
 
     // write the final results
-    memcpy(samplesOut, g->sampleBuffer, sampleCount*sizeof(gensyn_sample_t));
+    memcpy(samplesOut, g->cold->sampleBuffer, sampleCount*sizeof(gensyn_sample_t));
+}
+
+// A single gate to run within a plan.
+typedef struct {
+    gensyn_gate_t * gate;
+
+    // index of the first input buffer for this gate 
+    // within the plan's input buffer list.
+    uint32_t inOffset;
+
+    // the level of the gate: one more than the highest 
+    // level of the gates it depends on.
+    uint32_t level;
+
+    // the step's place in dependency order, which is 
+    // the order that the plan runs in without a pool.
+    uint32_t postIndex;
+
+    // the shared buffer that the gate writes to.
+    uint32_t bufferIndex;
+
+    // which of the plan's outputs the gate writes straight 
+    // into the caller's samples, or NO_STEP if none.
+    uint32_t outputIndex;
+} gensyn_gate_plan__step_t;
+
+
+// An output gate that the plan was compiled for.
+typedef struct {
+    gensyn_gate_t * gate;
+
+    // the step of the gate, and the buffer it writes to.
+    uint32_t step;
+    uint32_t buffer;
+
+    // whether the gate writes straight into the samples given 
+    // for this output. Not when a cycle reads it back or the 
+    // gate is given as more than one output.
+    int direct;
+} gensyn_gate_plan__output_t;
+
+
+struct gensyn_gate_plan_t {
+    // of type gensyn_gate_plan__output_t. The 
+    // gates the plan was compiled for.
+    gensyn_array_t * outputs;
+
+    // of type gensyn_gate_plan__step_t, in the order 
+    // that they need to be run. Steps are grouped by level.
+    gensyn_array_t * steps;
+
+    // of type uint32_t. The index of the first step of each 
+    // level, followed by the total number of steps. 
+    // Gates within the same level do not depend on each other.
+    gensyn_array_t * levels;
+
+    // of type uint32_t. The steps in dependency order. Running 
+    // them in this order keeps fewer outputs waiting to be read 
+    // than running a level at a time, so fewer buffers are needed.
+    gensyn_array_t * order;
+
+    // of type gensyn_gate_t *. Parallel to inBuffers, 
+    // it holds the source gate for each input buffer slot.
+    gensyn_array_t * inGates;
+
+    // of type uint32_t. Parallel to inGates, the step of each 
+    // source gate, or NO_STEP for unconnected inputs.
+    gensyn_array_t * inSteps;
+
+    // of type gensyn_sample_t *. The resolved input buffers 
+    // for all steps.
+    gensyn_array_t * inBuffers;
+
+    // buffers of GENSYN_GATE_PLAN_MAX_SAMPLES that the steps write to,
+    // one after the other. Gates whose outputs are never needed at 
+    // the same time share a buffer.
+    gensyn_sample_t * buffers;
+    uint32_t bufferCount;
+    uint32_t bufferCapacity;
+
+    // what each buffer holds. Buffers that hold the same constant 
+    // from run to run, such as silence, are not written again
+    // even when shared.
+    gensyn_gate__buffer_state_t * bufferStates;
+
+    // incremented each compile to mark visited gates.
+    uint32_t compileID;
+
+    // if set, levels are split across the pool.
+    gensyn_pool_t * pool;
+
+    // input events for the next run.
+    const gensyn_gate_event_t * events;
+    uint32_t eventCount;
+
+    // state for the level currently being run in the pool.
+    uint32_t runLevelStart;
+    uint32_t runSampleCount;
+    float    runSampleRate;
+
+    // where each output gate writes for the block being run.
+    gensyn_sample_t ** runOutputs;
+};
+
+
+gensyn_gate_plan_t * gensyn_gate_plan_create() {
+    gensyn_gate_plan_t * p = calloc(1, sizeof(gensyn_gate_plan_t));
+    p->steps     = gensyn_array_create(sizeof(gensyn_gate_plan__step_t));
+    p->levels    = gensyn_array_create(sizeof(uint32_t));
+    p->order     = gensyn_array_create(sizeof(uint32_t));
+    p->inGates   = gensyn_array_create(sizeof(gensyn_gate_t *));
+    p->inSteps   = gensyn_array_create(sizeof(uint32_t));
+    p->inBuffers = gensyn_array_create(sizeof(gensyn_sample_t *));
+    p->outputs   = gensyn_array_create(sizeof(gensyn_gate_plan__output_t));
+    return p;
+}
+
+void gensyn_gate_plan_destroy(gensyn_gate_plan_t * p) {
+    gensyn_array_destroy(p->steps);
+    gensyn_array_destroy(p->levels);
+    gensyn_array_destroy(p->order);
+    gensyn_array_destroy(p->inGates);
+    gensyn_array_destroy(p->inSteps);
+    gensyn_array_destroy(p->inBuffers);
+    gensyn_array_destroy(p->outputs);
+    free(p->buffers);
+    free(p->bufferStates);
+    free(p);
+}
+
+
+// Adds the gate and its dependencies to the plan in post-order.
+// The updateID marks gates that are already in the plan. Like the 
+// original run, a gate that is reached again through a cycle
+// provides whatever it computed last iteration.
+static void gensyn_gate_plan_compile__visit(gensyn_gate_plan_t * p, gensyn_gate_t * g) {
+    if (g->updateID == p->compileID) return;
+    g->updateID = p->compileID;
+
+    int i;
+    for(i = 0; i < g->nins; ++i) {
+        if (g->inrefs[i]) {
+            gensyn_gate_plan_compile__visit(p, g->inrefs[i]);
+        }
+    }
+
+    gensyn_gate_plan__step_t step;
+    step.gate = g;
+    step.inOffset = gensyn_array_get_size(p->inGates);
+    step.level = 0;
+    step.postIndex = gensyn_array_get_size(p->steps);
+    step.outputIndex = NO_STEP;
+    g->planIndex = step.postIndex;
+    gensyn_array_push_n(p->inGates, g->inrefs, g->nins);
+    gensyn_array_push(p->steps, step);
+}
+
+
+// Assigns levels to each step and reorders the steps by level.
+// Only inputs that come earlier in post-order count as dependencies;
+// later ones are cycles, which read the previous iteration 
+// in both orders.
+static void gensyn_gate_plan_compile__levels(gensyn_gate_plan_t * p) {
+    uint32_t len = gensyn_array_get_size(p->steps);
+    gensyn_gate_plan__step_t * steps = gensyn_array_get_data(p->steps);
+    gensyn_gate_t ** inGates = gensyn_array_get_data(p->inGates);
+    uint32_t levelCount = 0;
+    uint32_t i, n;
+    for(i = 0; i < len; ++i) {
+        for(n = 0; n < steps[i].gate->nins; ++n) {
+            gensyn_gate_t * from = inGates[steps[i].inOffset + n];
+            if (from && from->planIndex < i && steps[from->planIndex].level+1 > steps[i].level) {
+                steps[i].level = steps[from->planIndex].level+1;
+            }
+        }
+        if (steps[i].level+1 > levelCount) levelCount = steps[i].level+1;
+    }
+
+    // stable counting sort by level.
+    gensyn_array_set_size(p->levels, levelCount+1);
+    uint32_t * levels = gensyn_array_get_data(p->levels);
+    for(i = 0; i <= levelCount; ++i) levels[i] = 0;
+    for(i = 0; i < len; ++i) levels[steps[i].level+1]++;
+    for(i = 0; i < levelCount; ++i) levels[i+1] += levels[i];
+
+    gensyn_gate_plan__step_t sorted[len];
+    uint32_t fill[levelCount];
+    for(i = 0; i < levelCount; ++i) fill[i] = levels[i];
+    for(i = 0; i < len; ++i) sorted[fill[steps[i].level]++] = steps[i];
+    gensyn_array_set_size(p->order, len);
+    for(i = 0; i < len; ++i) {
+        steps[i] = sorted[i];
+        steps[i].gate->planIndex = i;
+        gensyn_array_at(p->order, uint32_t, steps[i].postIndex) = i;
+    }
+
+    // gates can be in more than one plan, so later passes 
+    // only go by the steps.
+    len = gensyn_array_get_size(p->inGates);
+    gensyn_array_set_size(p->inSteps, len);
+    for(i = 0; i < len; ++i) {
+        gensyn_array_at(p->inSteps, uint32_t, i) = inGates[i] ? inGates[i]->planIndex : NO_STEP;
+    }
+
+    uint32_t outputCount = gensyn_array_get_size(p->outputs);
+    gensyn_gate_plan__output_t * outputs = gensyn_array_get_data(p->outputs);
+    for(i = 0; i < outputCount; ++i) {
+        outputs[i].step = outputs[i].gate->planIndex;
+        outputs[i].direct = 1;
+        uint32_t * index = &steps[outputs[i].step].outputIndex;
+        if (*index == NO_STEP) {
+            *index = i;
+        } else {
+            outputs[i].direct = outputs[*index].direct = 0;
+        }
+    }
+    for(i = 0; i < len; ++i) {
+        uint32_t from = gensyn_array_at(p->inSteps, uint32_t, i);
+        if (from != NO_STEP && steps[from].outputIndex != NO_STEP) {
+            outputs[steps[from].outputIndex].direct = 0;
+        }
+    }
+    for(i = 0; i < outputCount; ++i) {
+        if (!outputs[i].direct) {
+            steps[outputs[i].step].outputIndex = NO_STEP;
+        }
+    }
+}
+
+
+// Gives each step a buffer, reusing the buffers of gates 
+// whose outputs have been read for the last time. Buffers are 
+// assigned for the order that the plan runs in: one step at 
+// a time in dependency order, or a level at a time with a pool. 
+// A freed buffer is only reused by steps that run strictly later,
+// since steps that run at the same time as its last reader, 
+// including that reader itself, may still be reading it.
+static void gensyn_gate_plan_compile__buffers(gensyn_gate_plan_t * p) {
+    uint32_t len = gensyn_array_get_size(p->steps);
+    gensyn_gate_plan__step_t * steps = gensyn_array_get_data(p->steps);
+    uint32_t * inSteps = gensyn_array_get_data(p->inSteps);
+    uint32_t * order = p->pool ? NULL : gensyn_array_get_data(p->order);
+    uint32_t i, n, k;
+
+    // when each step runs. Steps with the same time may run at once.
+    uint32_t time[len];
+    uint32_t end = order ? len : gensyn_gate_plan_get_level_count(p);
+    for(k = 0; k < len; ++k) {
+        i = order ? order[k] : k;
+        time[i] = order ? k : steps[i].level;
+    }
+
+    // the last time that each step's output is read. Outputs that are 
+    // read through a cycle carry over to the next run, so they keep 
+    // their buffer for good, as do the plan's outputs.
+    uint32_t outputCount = gensyn_array_get_size(p->outputs);
+    gensyn_gate_plan__output_t * outputs = gensyn_array_get_data(p->outputs);
+    uint32_t lastUse[len];
+    for(i = 0; i < len; ++i) lastUse[i] = time[i];
+    for(i = 0; i < outputCount; ++i) lastUse[outputs[i].step] = end;
+    for(i = 0; i < len; ++i) {
+        for(n = 0; n < steps[i].gate->nins; ++n) {
+            uint32_t from = inSteps[steps[i].inOffset + n];
+            if (from == NO_STEP) continue;
+            if (steps[from].postIndex >= steps[i].postIndex) {
+                lastUse[from] = end;
+            } else if (time[i] > lastUse[from]) {
+                lastUse[from] = time[i];
+            }
+        }
+    }
+
+    // steps sorted by last use, to free their buffers in order.
+    uint32_t ends[end+2];
+    uint32_t byEnd[len];
+    for(i = 0; i < end+2; ++i) ends[i] = 0;
+    for(i = 0; i < len; ++i) ends[lastUse[i]+1]++;
+    for(i = 0; i < end; ++i) ends[i+1] += ends[i];
+    uint32_t fill[end+1];
+    for(i = 0; i <= end; ++i) fill[i] = ends[i];
+    for(i = 0; i < len; ++i) byEnd[fill[lastUse[i]]++] = i;
+
+    uint32_t freeList[len];
+    uint32_t freeCount = 0;
+    uint32_t released = 0;
+    p->bufferCount = 0;
+    for(k = 0; k < len; ++k) {
+        i = order ? order[k] : k;
+        for(; released < time[i]; ++released) {
+            for(n = ends[released]; n < ends[released+1]; ++n) {
+                freeList[freeCount++] = steps[byEnd[n]].bufferIndex;
+            }
+        }
+        if (freeCount) {
+            steps[i].bufferIndex = freeList[--freeCount];
+        } else {
+            steps[i].bufferIndex = p->bufferCount++;
+        }
+    }
+
+    if (p->bufferCount > p->bufferCapacity) {
+        free(p->buffers);
+        p->buffers = aligned_alloc(
+            PLAN_BUFFER_ALIGNMENT, 
+            p->bufferCount*GENSYN_GATE_PLAN_MAX_SAMPLES*sizeof(gensyn_sample_t)
+        );
+        free(p->bufferStates);
+        p->bufferStates = malloc(p->bufferCount*sizeof(gensyn_gate__buffer_state_t));
+        p->bufferCapacity = p->bufferCount;
+    }
+    for(i = 0; i < p->bufferCount; ++i) {
+        p->bufferStates[i].isConstant = 0;
+    }
+
+    for(i = 0; i < len; ++i) {
+        gensyn_gate__reserve_control(steps[i].gate, GENSYN_GATE_PLAN_MAX_SAMPLES);
+    }
+    for(i = 0; i < outputCount; ++i) {
+        outputs[i].buffer = steps[outputs[i].step].bufferIndex;
+    }
+
+    len = gensyn_array_get_size(p->inSteps);
+    gensyn_array_set_size(p->inBuffers, len);
+    for(i = 0; i < len; ++i) {
+        uint32_t from = inSteps[i];
+        gensyn_array_at(p->inBuffers, gensyn_sample_t *, i) = from != NO_STEP ? 
+            p->buffers + steps[from].bufferIndex*GENSYN_GATE_PLAN_MAX_SAMPLES
+        :
+            NULL;
+    }
+}
+
+
+void gensyn_gate_plan_compile(gensyn_gate_plan_t * p, gensyn_gate_t * output) {
+    gensyn_gate_plan_compile_outputs(p, &output, output ? 1 : 0);
+}
+
+void gensyn_gate_plan_compile_outputs(gensyn_gate_plan_t * p, gensyn_gate_t ** outputs, uint32_t outputCount) {
+    gensyn_array_clear(p->steps);
+    gensyn_array_clear(p->levels);
+    gensyn_array_clear(p->order);
+    gensyn_array_clear(p->inGates);
+    gensyn_array_clear(p->inSteps);
+    gensyn_array_clear(p->inBuffers);
+    gensyn_array_clear(p->outputs);
+    p->bufferCount = 0;
+    if (!outputCount) return;
+
+    // compile IDs share the update ID space so that they never 
+    // collide with a run in progress.
+    p->compileID = gensyn_gate__next_update_id(outputs[0]);
+    uint32_t i;
+    for(i = 0; i < outputCount; ++i) {
+        gensyn_gate_plan__output_t output = {0};
+        output.gate = outputs[i];
+        gensyn_array_push(p->outputs, output);
+
+        // gates shared between outputs are only visited once.
+        gensyn_gate_plan_compile__visit(p, outputs[i]);
+    }
+    gensyn_gate_plan_compile__levels(p);
+    gensyn_gate_plan_compile__buffers(p);
+}
+
+uint32_t gensyn_gate_plan_get_output_count(const gensyn_gate_plan_t * p) {
+    return gensyn_array_get_size(p->outputs);
 }
 
+uint32_t gensyn_gate_plan_get_gate_count(const gensyn_gate_plan_t * p) {
+    return gensyn_array_get_size(p->steps);
+}
+
+gensyn_gate_t * gensyn_gate_plan_get_gate(const gensyn_gate_plan_t * p, uint32_t index) {
+    if (index >= gensyn_array_get_size(p->steps)) return NULL;
+    return gensyn_array_at(p->steps, gensyn_gate_plan__step_t, index).gate;
+}
+
+uint32_t gensyn_gate_plan_get_level_count(const gensyn_gate_plan_t * p) {
+    uint32_t len = gensyn_array_get_size(p->levels);
+    return len ? len-1 : 0;
+}
+
+uint32_t gensyn_gate_plan_get_buffer_count(const gensyn_gate_plan_t * p) {
+    return p->bufferCount;
+}
+
+void gensyn_gate_plan_set_pool(gensyn_gate_plan_t * p, gensyn_pool_t * pool) {
+    int reorder = !pool != !p->pool;
+    p->pool = pool;
+
+    // buffers are shared differently when run a level at a time.
+    if (reorder && gensyn_array_get_size(p->outputs)) {
+        gensyn_gate_plan_compile__buffers(p);
+    }
+}
+
+void gensyn_gate_plan_set_events(gensyn_gate_plan_t * p, const gensyn_gate_event_t * events, uint32_t eventCount) {
+    p->events = events;
+    p->eventCount = eventCount;
+}
+
+
+static void gensyn_gate_plan__run_step(
+    gensyn_gate_plan_t * p,
+    const gensyn_gate_plan__step_t * step,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    gensyn_sample_t * buffer = p->buffers + step->bufferIndex*GENSYN_GATE_PLAN_MAX_SAMPLES;
+    gensyn_gate__buffer_state_t * state = p->bufferStates + step->bufferIndex;
+
+    // nothing is known of what the caller's samples hold.
+    gensyn_gate__buffer_state_t outputState = {0};
+    if (step->outputIndex != NO_STEP && p->runOutputs[step->outputIndex]) {
+        buffer = p->runOutputs[step->outputIndex];
+        state = &outputState;
+    }
+    step->gate->runInrefs = ((gensyn_gate_t **)gensyn_array_get_data(p->inGates)) + step->inOffset;
+
+    gensyn_gate__update(
+        step->gate,
+        buffer,
+        state,
+        ((gensyn_sample_t **)gensyn_array_get_data(p->inBuffers)) + step->inOffset,
+        p->events,
+        p->eventCount,
+        sampleCount,
+        sampleRate
+    );
+}
+
+// pool task: runs one step of the current level.
+static void gensyn_gate_plan__run_pool_task(void * src, uint32_t index) {
+    gensyn_gate_plan_t * p = src;
+    gensyn_gate_plan__run_step(
+        p,
+        &gensyn_array_at(p->steps, gensyn_gate_plan__step_t, p->runLevelStart + index),
+        p->runSampleCount,
+        p->runSampleRate
+    );
+}
+
+
+// Runs the plan once for at most GENSYN_GATE_PLAN_MAX_SAMPLES.
+static void gensyn_gate_plan__run_block(
+    gensyn_gate_plan_t * p, 
+    gensyn_sample_t ** samplesOut, 
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    gensyn_gate_plan__step_t * steps = gensyn_array_get_data(p->steps);
+    uint32_t * order = gensyn_array_get_data(p->order);
+    uint32_t len = gensyn_array_get_size(p->steps);
+    uint32_t i;
+
+    p->runOutputs = samplesOut;
+    if (!p->pool) {
+        for(i = 0; i < len; ++i) {
+            gensyn_gate_plan__run_step(p, steps + order[i], sampleCount, sampleRate);
+        }
+    } else {
+        // each gate writes a buffer that nothing else in its level 
+        // touches and reads from earlier levels, so the result 
+        // matches the serial order exactly.
+        uint32_t * levels = gensyn_array_get_data(p->levels);
+        uint32_t levelCount = gensyn_gate_plan_get_level_count(p);
+        p->runSampleCount = sampleCount;
+        p->runSampleRate  = sampleRate;
+        for(i = 0; i < levelCount; ++i) {
+            p->runLevelStart = levels[i];
+            gensyn_pool_run(
+                p->pool,
+                levels[i+1] - levels[i],
+                gensyn_gate_plan__run_pool_task,
+                p
+            );
+        }
+    }
+
+    // write the final results, unless the output gates already have.
+    uint32_t outputCount = gensyn_array_get_size(p->outputs);
+    const gensyn_gate_plan__output_t * outputs = gensyn_array_get_data(p->outputs);
+    for(i = 0; i < outputCount; ++i) {
+        if (!samplesOut[i] || outputs[i].direct) continue;
+        memcpy(
+            samplesOut[i], 
+            p->buffers + outputs[i].buffer*GENSYN_GATE_PLAN_MAX_SAMPLES, 
+            sampleCount*sizeof(gensyn_sample_t)
+        );
+    }
+}
+
+
+void gensyn_gate_plan_run(
+    gensyn_gate_plan_t * p, 
+    gensyn_sample_t * samplesOut, 
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    uint32_t outputCount = gensyn_array_get_size(p->outputs);
+    if (!outputCount) return;
+
+    gensyn_sample_t * channels[outputCount];
+    uint32_t i;
+    channels[0] = samplesOut;
+    for(i = 1; i < outputCount; ++i) channels[i] = NULL;
+    gensyn_gate_plan_run_planar(p, channels, sampleCount, sampleRate);
+}
+
+
+void gensyn_gate_plan_run_planar(
+    gensyn_gate_plan_t * p, 
+    gensyn_sample_t ** samplesOut, 
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    uint32_t outputCount = gensyn_array_get_size(p->outputs);
+    if (!outputCount) return;
+
+    if (sampleCount <= GENSYN_GATE_PLAN_MAX_SAMPLES) {
+        gensyn_gate_plan__run_block(p, samplesOut, sampleCount, sampleRate);
+    } else {
+        // longer blocks are run in parts, each given its own events.
+        const gensyn_gate_event_t * events = p->events;
+        uint32_t eventCount = p->eventCount;
+        gensyn_gate_event_t partEvents[eventCount ? eventCount : 1];
+        gensyn_sample_t * partOut[outputCount];
+        uint32_t offset, count, i;
+        uint32_t nextEvent = 0;
+        for(offset = 0; offset < sampleCount; offset += count) {
+            count = sampleCount - offset;
+            if (count > GENSYN_GATE_PLAN_MAX_SAMPLES) count = GENSYN_GATE_PLAN_MAX_SAMPLES;
+
+            p->eventCount = 0;
+            p->events = partEvents;
+            for(; nextEvent < eventCount && events[nextEvent].offset < offset + count; ++nextEvent) {
+                partEvents[p->eventCount] = events[nextEvent];
+                partEvents[p->eventCount++].offset -= offset;
+            }
+            for(i = 0; i < outputCount; ++i) {
+                partOut[i] = samplesOut[i] ? samplesOut[i] + offset : NULL;
+            }
+            gensyn_gate_plan__run_block(p, partOut, count, sampleRate);
+        }
+    }
+
+    p->events = NULL;
+    p->eventCount = 0;
+}
+
+
 // Returns whether the gate was used last output cycle
 int gensyn_gate_get_is_active(const gensyn_gate_t * g) {
     return g->isActive; 
@@ -284,6 +1481,27 @@ void gensyn_gate_reset_is_active(gensyn_gate_t * g) {
     g->isActive = 0;
 }
 
+int gensyn_gate_get_is_silent(const gensyn_gate_t * g) {
+    return g->isConstant && g->constantValue == 0.f;
+}
+
+int gensyn_gate_get_in_is_silent(const gensyn_gate_t * g, int index) {
+    if (index < 0 || index >= g->nins || !g->runInrefs || !g->runInrefs[index]) return 0;
+    return gensyn_gate_get_is_silent(g->runInrefs[index]);
+}
+
+int gensyn_gate_get_in_constant(const gensyn_gate_t * g, int index, float * value) {
+    if (index < 0 || index >= g->nins || !g->runInrefs || !g->runInrefs[index]) return 0;
+    if (!g->runInrefs[index]->isConstant) return 0;
+    *value = g->runInrefs[index]->constantValue;
+    return 1;
+}
+
+int gensyn_gate_output_constant(gensyn_gate_t * g, float value) {
+    g->outputValue = value;
+    return GENSYN_GATE__OUTPUT__CONSTANT;
+}
+
 
 
 // Sets the IN gate for the name.
@@ -293,34 +1511,26 @@ void gensyn_gate_connect(
     gensyn_gate_t * to
 ) {
     int i;
-    // max connections reached. 
-    if (from && from->nouts >= MAX_CX) {
-        return;
-    }
-
     for(i = 0; i < to->nins; ++i) {
-        if (gensyn_string_test_eq(gensyn_array_at(to->innamesArr, gensyn_string_t *, i), name)) {
+        if (gensyn_string_test_eq(gensyn_array_at(to->cold->innamesArr, gensyn_string_t *, i), name)) {
             
             if (to->inrefs[i] != NULL) { // remove old ref from tree
-                gensyn_gate_t * oldRef = to->inrefs[i];
-                int n;
-                for(n = 0; n < oldRef->nouts; ++n) {
-                    if (oldRef->outrefs[n] == to) {
-                        oldRef->outrefs[n] = NULL;
-                        oldRef->nouts--;
-
-                        // fill gap
-                        for(; n < oldRef->nouts; ++n) {
-                            oldRef->outrefs[n] = oldRef->outrefs[n+1]; 
-                        }
+                gensyn_array_t * oldRefs = to->inrefs[i]->cold->outrefs;
+                uint32_t n;
+                for(n = 0; n < gensyn_array_get_size(oldRefs); ++n) {
+                    if (gensyn_array_at(oldRefs, gensyn_gate_t *, n) == to) {
+                        gensyn_array_remove(oldRefs, n);
                         break;
                     }
                 }
             }
             if (from) {
-                from->outrefs[from->nouts++] = to;
+                gensyn_array_push(from->cold->outrefs, to);
             }
             to->inrefs[i] = from;
+            if (to->cold->context) {
+                gensyn_mark_circuit_changed(to->cold->context);
+            }
             return;
         }
     }
@@ -342,24 +1552,86 @@ void gensyn_gate_disconnect(
 
 // Returns the value of a parameter
 float gensyn_gate_get_parameter(const gensyn_gate_t * g, const gensyn_string_t * name) {
+    return gensyn_gate_get_parameter_by_handle(g, gensyn_gate_get_parameter_handle(g, name));
+}
+
+// Sets the value of a parameter
+void gensyn_gate_set_parameter(gensyn_gate_t * g, const gensyn_string_t * name, float data) {
+    gensyn_gate_set_parameter_by_handle(g, gensyn_gate_get_parameter_handle(g, name), data);
+}
+
+
+int gensyn_gate_get_parameter_handle(const gensyn_gate_t * g, const gensyn_string_t * name) {
     int i;
     for(i = 0; i < g->nparams; ++i) {
-        if (gensyn_string_test_eq(gensyn_array_at(g->paramnamesArr, gensyn_string_t *, i), name)) {
-            return g->params[i];
+        if (gensyn_string_test_eq(gensyn_array_at(g->cold->paramnamesArr, gensyn_string_t *, i), name)) {
+            return i;
         }
     }
-    return 0.f;
+    return -1;
 }
 
-// Sets the value of a parameter
-void gensyn_gate_set_parameter(gensyn_gate_t * g, const gensyn_string_t * name, float data) {
+float gensyn_gate_get_parameter_by_handle(const gensyn_gate_t * g, int handle) {
+    if (handle < 0 || handle >= g->nparams) return 0.f;
+    return g->params[handle];
+}
+
+void gensyn_gate_set_parameter_by_handle(gensyn_gate_t * g, int handle, float data) {
+    if (handle < 0 || handle >= g->nparams) return;
+
+    // not a live gate (prefab)
+    if (!g->automation) {
+        g->params[handle] = data;
+        return;
+    }
+    uint32_t bits;
+    memcpy(&bits, &data, sizeof(float));
+    atomic_store_explicit(g->automation->requested+handle, bits, memory_order_relaxed);
+    atomic_fetch_or_explicit(
+        g->automation->requestedMask + handle/PARAM_MASK_BITS, 
+        1u << (handle%PARAM_MASK_BITS), 
+        memory_order_release
+    );
+}
+
+void gensyn_gate_copy_parameters(gensyn_gate_t * to, const gensyn_gate_t * from) {
+    uint32_t mask = 0;
     int i;
-    for(i = 0; i < g->nparams; ++i) {
-        if (gensyn_string_test_eq(gensyn_array_at(g->paramnamesArr, gensyn_string_t *, i), name)) {
-            g->params[i] = data;
+    for(i = 0; i < from->nparams && i < to->nparams; ++i) {
+        if (from->automation && !(i % PARAM_MASK_BITS)) {
+            mask = atomic_load_explicit(from->automation->requestedMask + i/PARAM_MASK_BITS, memory_order_acquire);
         }
+        float value = from->params[i];
+        if (mask & (1u << (i%PARAM_MASK_BITS))) {
+            uint32_t bits = atomic_load_explicit(from->automation->requested+i, memory_order_relaxed);
+            memcpy(&value, &bits, sizeof(float));
+        }
+        gensyn_gate_set_parameter_by_handle(to, i, value);
     }
-    
+}
+
+int gensyn_gate_schedule_parameter(
+    gensyn_gate_t * g, 
+    int handle, 
+    float value,
+    uint64_t sampleTick,
+    gensyn_gate__ramp_e ramp,
+    uint32_t rampLength
+) {
+    if (handle < 0 || handle >= g->nparams || !g->automation) return 0;
+    gensyn_gate__automation_t * a = g->automation;
+    uint32_t write = atomic_load_explicit(&a->write, memory_order_relaxed);
+    uint32_t read  = atomic_load_explicit(&a->read,  memory_order_acquire);
+    if (write - read >= MAX_PARAM_CHANGES) return 0;
+
+    gensyn_gate__param_change_t * c = a->queue + (write % MAX_PARAM_CHANGES);
+    c->sampleTick = sampleTick;
+    c->value = value;
+    c->handle = handle;
+    c->ramp = ramp;
+    c->rampLength = rampLength;
+    atomic_store_explicit(&a->write, write+1, memory_order_release);
+    return 1;
 }
 
 
@@ -370,7 +1642,7 @@ void gensyn_gate_set_parameter(gensyn_gate_t * g, const gensyn_string_t * name,
 gensyn_gate_t * gensyn_gate_get_in_connection(const gensyn_gate_t * g, const gensyn_string_t * name) {
     int i;
     for(i = 0; i < g->nins; ++i) {
-        if (gensyn_string_test_eq(gensyn_array_at(g->innamesArr, gensyn_string_t *, i), name)) {
+        if (gensyn_string_test_eq(gensyn_array_at(g->cold->innamesArr, gensyn_string_t *, i), name)) {
             return g->inrefs[i];
         }
     }
@@ -380,32 +1652,34 @@ gensyn_gate_t * gensyn_gate_get_in_connection(const gensyn_gate_t * g, const gen
 // Gets an OUT gate for the given registered OUT.
 // If none exists, NULL is returned.
 gensyn_gate_t * gensyn_gate_get_out_connection(const gensyn_gate_t * g, int index) {
-    return g->outrefs[index];
+    if (index < 0 || index >= (int)gensyn_array_get_size(g->cold->outrefs)) return NULL;
+    return gensyn_array_at(g->cold->outrefs, gensyn_gate_t *, index);
 }
 
 
 const gensyn_array_t * gensyn_gate_get_in_names(const gensyn_gate_t * g) {
-    return g->innamesArr;
+    return g->cold->innamesArr;
 }
 
 const gensyn_array_t * gensyn_gate_get_param_names(const gensyn_gate_t * g) {
-    return g->paramnamesArr;
+    return g->cold->paramnamesArr;
 }
 
 
 int gensyn_gate_get_out_connection_count(const gensyn_gate_t * g) {
-    return g->nouts;
+    return g->cold->outrefs ? gensyn_array_get_size(g->cold->outrefs) : 0;
 }
 
 
 gensyn_gate__type_e gensyn_gate_get_type(const gensyn_gate_t * g) {
-    if (g->nins && g->nouts) 
+    int nouts = gensyn_gate_get_out_connection_count(g);
+    if (g->nins && nouts) 
         return GENSYN_GATE__TYPE__TRANSFORM;
     
-    if (g->nins && !g->nouts)
+    if (g->nins && !nouts)
         return GENSYN_GATE__TYPE__OUTPUT;
     
-    if (g->nouts && !g->nins) 
+    if (nouts && !g->nins) 
         return GENSYN_GATE__TYPE__INPUT;
     
     return GENSYN_GATE__TYPE__NULL;
@@ -413,47 +1687,131 @@ gensyn_gate__type_e gensyn_gate_get_type(const gensyn_gate_t * g) {
 
 
 const gensyn_string_t * gensyn_gate_get_description(const gensyn_gate_t * g) {
-    return g->desc;
+    return g->cold->desc;
 }
 
 const gensyn_string_t * gensyn_gate_get_class(const gensyn_gate_t * g) {
-    return g->type;
+    return g->cold->type;
 }
 
 
 int gensyn_gate_get_x(const gensyn_gate_t * g) {
-    return g->x;
+    return g->cold->x;
 }
 
 int gensyn_gate_get_y(const gensyn_gate_t * g) {
-    return g->y;
+    return g->cold->y;
 }
 
 void gensyn_gate_set_x(gensyn_gate_t * g, int x) {
-    g->x = x;
+    g->cold->x = x;
 }
 void gensyn_gate_set_y(gensyn_gate_t * g, int y) {
-    g->y = y;
+    g->cold->y = y;
 }
 
 int gensyn_gate_reads_input(const gensyn_gate_t * g) {
-    return g->onInput != NULL;
+    return g->cold->onInput != NULL;
+}
+
+void * gensyn_gate_get_data(const gensyn_gate_t * g) {
+    return g->data;
 }
 
 void gensyn_gate_send_event(gensyn_gate_t * g, const gensyn_system__input_event_t * event) {
-    if (!g->onInput) return;
-    g->onInput(g, event, g->data);
+    if (!g->cold->onInput) return;
+    g->cold->onInput(g, event, g->data);
 }
 
 
 //////// statics 
 
 
-gensyn_gate_t * gensyn_gate_clone(const gensyn_gate_t * src) {
-    gensyn_gate_t * g = malloc(sizeof(gensyn_gate_t));
+static void gensyn_gate__prefab_destroy(gensyn_gate_t * g) {
+    gensyn_gate__cold_t * cold = g->cold;
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(cold->innamesArr); ++i) {
+        gensyn_string_destroy(gensyn_array_at(cold->innamesArr, gensyn_string_t *, i));
+    }
+    for(i = 0; i < gensyn_array_get_size(cold->paramnamesArr); ++i) {
+        gensyn_string_destroy(gensyn_array_at(cold->paramnamesArr, gensyn_string_t *, i));
+    }
+    gensyn_array_destroy(cold->innamesArr);
+    gensyn_array_destroy(cold->paramnamesArr);
+    gensyn_string_destroy(cold->desc);
+    gensyn_string_destroy(cold->type);
+    if (cold->arena) gensyn_arena_destroy(cold->arena);
+    if (cold->automations) gensyn_arena_destroy(cold->automations);
+    free(cold);
+    free(g->inrefs);
+    free(g->params);
+    free(g);
+}
+
+static int gensyn_gate__add_in(gensyn_gate_t * g, const gensyn_string_t * name) {
+    gensyn_array_t * names = g->cold->innamesArr;
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(names); ++i) {
+        if (gensyn_string_test_eq(gensyn_array_at(names, gensyn_string_t *, i), name)) {
+            return 0;
+        }
+    }
+    gensyn_string_t * entry = gensyn_string_clone(name);
+    gensyn_array_push(names, entry);
+    g->inrefs = realloc(g->inrefs, (g->nins+1)*sizeof(gensyn_gate_t *));
+    g->inrefs[g->nins++] = NULL;
+    return 1;
+}
+
+static int gensyn_gate__add_param(gensyn_gate_t * g, const gensyn_string_t * name, float value) {
+    gensyn_array_t * names = g->cold->paramnamesArr;
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(names); ++i) {
+        if (gensyn_string_test_eq(gensyn_array_at(names, gensyn_string_t *, i), name)) {
+            return 0;
+        }
+    }
+    gensyn_string_t * entry = gensyn_string_clone(name);
+    gensyn_array_push(names, entry);
+    g->params = realloc(g->params, (g->nparams+1)*sizeof(float));
+    g->params[g->nparams++] = value;
+    return 1;
+}
+
+static uint32_t gensyn_gate__automation_layout(gensyn_gate__automation_t * a, void * block, int nparams) {
+    uint32_t size      = GATE_SLOT_ALIGN(nparams*sizeof(uint32_t));
+    uint32_t ramps     = size; size = GATE_SLOT_ALIGN(size + nparams*sizeof(gensyn_gate__param_ramp_t));
+    uint32_t queue     = size; size += MAX_PARAM_CHANGES*sizeof(gensyn_gate__param_change_t);
+    uint32_t pending   = size; size += MAX_PARAM_CHANGES*sizeof(gensyn_gate__param_change_t);
+    if (a) {
+        uint8_t * base = block;
+        memset(a, 0, sizeof(gensyn_gate__automation_t) + PARAM_MASK_WORDS(nparams)*sizeof(uint32_t));
+        memset(block, 0, size);
+        a->requested = (_Atomic uint32_t *)base;
+        a->ramps     = (gensyn_gate__param_ramp_t *)(base + ramps);
+        a->queue     = (gensyn_gate__param_change_t *)(base + queue);
+        a->pending   = (gensyn_gate__param_change_t *)(base + pending);
+    }
+    return size;
+}
+
+static uint32_t gensyn_gate__next_update_id(gensyn_gate_t * g) {
+    return atomic_fetch_add(&gensyn_get_gate_registry(g->cold->context)->updatePool, 1) + 1;
+}
+
+gensyn_gate_t * gensyn_gate_clone(gensyn_gate_registry_t * r, const gensyn_gate_t * src) {
+    gensyn_gate_t * g = gensyn_arena_alloc(src->cold->arena);
+    gensyn_gate__cold_t * cold = gensyn_arena_alloc(r->colds);
     // since the arrays for names are readonly and all refs are started at 0 anyway,
     // it should be, for once, safe to do a shallow copy.
     *g = *src;
-
+    *cold = *src->cold;
+    cold->outrefs = gensyn_array_create(sizeof(gensyn_gate_t *));
+    g->cold = cold;
+
+    g->inrefs = (gensyn_gate_t **)(g+1);
+    memset(g->inrefs, 0, g->nins*sizeof(gensyn_gate_t *));
+    g->params = (float *)(g->inrefs + g->nins);
+    if (g->nparams) memcpy(g->params, src->params, g->nparams*sizeof(float));
     return g;
 }
@@ -1,6 +1,12 @@
 
 
 
+// parameter handles, in registration order.
+enum {
+    ADDER__PARAM__NORMALIZE
+};
+
+
 static void * adder__on_create(gensyn_gate_t * g) {
     return NULL;
 }
@@ -9,36 +15,47 @@ static int adder__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
     void *              userData
 ) {
 
-    uint32_t i, n;
-    uint16_t sampleTick = gensyn_gate_get_sample_tick(gate);
-    gensyn_sample_t * ins[nIn];
-    int inReal = 0;
+    uint32_t i;
+    float value;
+
+    // constant inputs add up to a constant, in the same order as the samples would.
+    float sum = 0;
     for(i = 0; i < nIn; ++i) {
-        if (inSampleBuffers[i])
-            ins[inReal++] = inSampleBuffers[i];
+        if (!inSampleBuffers[i]) continue;
+        if (!gensyn_gate_get_in_constant(gate, i, &value)) break;
+        sum += value;
     }
-    
-    float highest = 0;
-    for(i = 0; i < sampleCount; ++i) {
-        buffer[i] = 0;
-        for(n = 0; n < inReal; ++n) {
-            buffer[i] += ins[n][i];
+    if (i == nIn) {
+        if (gensyn_gate_get_parameter_by_handle(gate, ADDER__PARAM__NORMALIZE) > .5 && sum != 0) {
+            sum = sum > 0 ? 1.f : -1.f;
+        }
+        return gensyn_gate_output_constant(gate, sum);
+    }
+
+    int written = 0;
+    for(i = 0; i < nIn; ++i) {
+        if (!inSampleBuffers[i] || gensyn_gate_get_in_is_silent(gate, i)) continue;
+        if (written) {
+            gensyn_vector_mix(buffer, inSampleBuffers[i], sampleCount);
+        } else {
+            memcpy(buffer, inSampleBuffers[i], sizeof(gensyn_sample_t)*sampleCount);
+            written = 1;
         }
-        if (fabs(buffer[i]) > highest)
-            highest = fabs(buffer[i]);
     }
     
     // normalize
-    if (highest > 0 && (gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("normalize")) > .5)) {
-        for(i = 0; i < sampleCount; ++i) {
-            buffer[i] /= highest;            
-        }
+    if (gensyn_gate_get_parameter_by_handle(gate, ADDER__PARAM__NORMALIZE) > .5) {
+        float highest = gensyn_vector_peak(buffer, sampleCount);
+        if (highest > 0)
+            gensyn_vector_scale(buffer, buffer, 1.f / highest, sampleCount);
     }
     return 1;
 }
@@ -48,8 +65,9 @@ static void adder__on_remove(gensyn_gate_t * g, void * data) {
 }
 
 
-void gensyn_gate_add__adder() {
+void gensyn_gate_add__adder(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Adder"),
         GENSYN_STR_CAST("Takes multiple gates and adds their output together. The output is normalized."),
 
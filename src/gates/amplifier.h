@@ -1,6 +1,12 @@
 
 
 
+// parameter handles, in registration order.
+enum {
+    AMPLIFIER__PARAM__VOLUME
+};
+
+
 static void * amplifier__on_create(gensyn_gate_t * g) {
     return NULL;
 }
@@ -9,22 +15,26 @@ static int amplifier__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
     void *              userData
 ) {
-    float volume  = gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("volume"));
-    if (!inSampleBuffers[0]) return 0;
-    
-    uint32_t i;
-    
-    for(i = 0; i < sampleCount; ++i) {
-        buffer[i] = (inSampleBuffers[0][i] * volume);
+    float volume  = gensyn_gate_get_parameter_by_handle(gate, AMPLIFIER__PARAM__VOLUME);
+    if (!inSampleBuffers[0] || volume == 0) return 0;
 
-        if (buffer[i] >  1.f) buffer[i] =  1.f;
-        if (buffer[i] < -1.f) buffer[i] = -1.f;
+    float value;
+    if (gensyn_gate_get_in_constant(gate, 0, &value)) {
+        value *= volume;
+        if (value < -1.f) value = -1.f;
+        if (value >  1.f) value =  1.f;
+        return gensyn_gate_output_constant(gate, value);
     }
+    
+    gensyn_vector_scale(buffer, inSampleBuffers[0], volume, sampleCount);
+    gensyn_vector_clamp(buffer, buffer, -1.f, 1.f, sampleCount);
     return 1;
 }
 
@@ -33,8 +43,9 @@ static void amplifier__on_remove(gensyn_gate_t * g, void * userData) {
 }
 
 
-void gensyn_gate_add__amplifier() {
+void gensyn_gate_add__amplifier(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Simple_Amplifier"),
         GENSYN_STR_CAST("Aplifies or lessens the incoming sorce by scaling it. Amplitudes are clipped."),
 
@@ -42,6 +53,7 @@ void gensyn_gate_add__amplifier() {
         amplifier__on_create,
         amplifier__on_update,
         amplifier__on_remove,
+        NULL,
         
         
         GENSYN_GATE__PROPERTY__CONNECTION,  GENSYN_STR_CAST("input"),
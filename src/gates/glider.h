@@ -6,15 +6,26 @@ typedef struct {
     
 } glider__data_t;
 
+// parameter handles, in registration order.
+enum {
+    GLIDER__PARAM__INTERP_AMOUNT
+};
+
+
+// within this of a constant input, the glider has settled on it.
+#define GLIDER__SETTLED 0.00001f
+
 
 static void * glider__on_create(gensyn_gate_t * g) {
-    return calloc(1, sizeof(glider__data_t));
+    return gensyn_gate_get_data(g);
 }
 
 static int glider__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
@@ -22,12 +33,21 @@ static int glider__on_update(
 ) {
     if (!inSampleBuffers[0]) return 0;    
     glider__data_t * src = userData;
+
+    float target;
+    if (gensyn_gate_get_in_constant(gate, 0, &target) && fabsf(src->prevSample - target) < GLIDER__SETTLED) {
+        src->prevSample = target;
+        return gensyn_gate_output_constant(gate, target);
+    }
     
     
     
-    float val = gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("interp_amount"));
+    float val = gensyn_gate_get_parameter_by_handle(gate, GLIDER__PARAM__INTERP_AMOUNT);
     if (val > .99999) val = .99999;
     if (val < .00001) val = .00001;
+
+    // the amount is per sample, but the glider only runs once per control period.
+    val = 1.0 - pow(1.0 - val, GENSYN_GATE_CONTROL_PERIOD);
     
     
     uint32_t i;
@@ -43,8 +63,9 @@ static void glider__on_remove(gensyn_gate_t * g, void * data) {
 }
 
 
-void gensyn_gate_add__glider() {
+void gensyn_gate_add__glider(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Glider"),
         GENSYN_STR_CAST("Will interpolate between successive sample values."),
 
@@ -58,6 +79,8 @@ void gensyn_gate_add__glider() {
         GENSYN_GATE__PROPERTY__CONNECTION, GENSYN_STR_CAST("input"),
         
         GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("interp_amount"), .1,
+        GENSYN_GATE__PROPERTY__CONTROL_RATE,
+        GENSYN_GATE__PROPERTY__DATA_SIZE, sizeof(glider__data_t),
         GENSYN_GATE__PROPERTY__END
     );
     
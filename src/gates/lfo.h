@@ -1,41 +1,58 @@
 
 
 
+// parameter handles, in registration order.
+enum {
+    LFO__PARAM__HZ,
+    LFO__PARAM__MAX
+};
+
+
+typedef struct {
+    gensyn_oscillator_t osc;
+} lfo__data_t;
+
+
 static void * lfo__on_create(gensyn_gate_t * g) {
-    return NULL;
+    lfo__data_t * data = gensyn_gate_get_data(g);
+    gensyn_oscillator_init(&data->osc, GENSYN_OSCILLATOR__SHAPE__SINE);
+    return data;
 }
 
 static int lfo__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
     void *              userData
 ) {
-    float hz  = gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("hz"));
-    float max = gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("max"));
+    float hz  = gensyn_gate_get_parameter_by_handle(gate, LFO__PARAM__HZ);
+    float max = gensyn_gate_get_parameter_by_handle(gate, LFO__PARAM__MAX);
 
     if (max < 0) max = 0;
     if (max > 1) max = 1;
+    if (max == 0) return 0;
     
     uint32_t i;
-    uint16_t sampleTick = gensyn_gate_get_sample_tick(gate);
-    
+    lfo__data_t * src = userData;
+    gensyn_oscillator_run(&src->osc, buffer, sampleCount, hz, sampleRate);
     for(i = 0; i < sampleCount; ++i) {
-        buffer[i] = (sin(M_PI * 2 * ((i+sampleTick) / sampleRate)*hz))*max;
+        buffer[i] *= max;
     }
     return 1;
 }
 
 static void lfo__on_remove(gensyn_gate_t * g, void * data) {
-    
 }
 
 
-void gensyn_gate_add__lfo() {
+void gensyn_gate_add__lfo(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Simple_LFO"),
         GENSYN_STR_CAST("Provides simple, low-frequency oscillation as input"),
 
@@ -49,6 +66,8 @@ void gensyn_gate_add__lfo() {
         GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("hz"),   .5,
         GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("max"), 1.0,
 
+        GENSYN_GATE__PROPERTY__CONTROL_RATE,
+        GENSYN_GATE__PROPERTY__DATA_SIZE, sizeof(lfo__data_t),
         GENSYN_GATE__PROPERTY__END
     );
     
@@ -0,0 +1,81 @@
+// number of INs, named input0 and up.
+#define MIXER__INPUTS 64
+
+// parameter handles, in registration order.
+// gain0 and up follow volume, one for each IN.
+enum {
+    MIXER__PARAM__VOLUME,
+    MIXER__PARAM__GAIN0
+};
+
+
+static void * mixer__on_create(gensyn_gate_t * g) {
+    return NULL;
+}
+
+static int mixer__on_update(
+    gensyn_gate_t *     gate,
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    float volume = gensyn_gate_get_parameter_by_handle(gate, MIXER__PARAM__VOLUME);
+    const gensyn_sample_t * ins[nIn];
+    float gains[nIn];
+    uint32_t n = 0;
+    int allConstant = 1;
+    float sum = 0;
+    float value;
+    int i;
+    for(i = 0; i < nIn; ++i) {
+        if (!inSampleBuffers[i] || gensyn_gate_get_in_is_silent(gate, i)) continue;
+        float gain = gensyn_gate_get_parameter_by_handle(gate, MIXER__PARAM__GAIN0 + i) * volume;
+        if (gain == 0) continue;
+
+        if (allConstant && gensyn_gate_get_in_constant(gate, i, &value)) {
+            sum += value * gain;
+        } else {
+            allConstant = 0;
+        }
+        ins[n] = inSampleBuffers[i];
+        gains[n] = gain;
+        n++;
+    }
+
+    if (!n) return 0;
+    if (allConstant) return gensyn_gate_output_constant(gate, sum);
+
+    // all the INs at once, rather than one pass over the buffer for each.
+    gensyn_vector_sum_scaled(buffer, ins, gains, n, sampleCount);
+    return 1;
+}
+
+static void mixer__on_remove(gensyn_gate_t * g, void * userData) {
+
+}
+
+
+void gensyn_gate_add__mixer(gensyn_t * ctx) {
+    gensyn_gate_register(
+        ctx,
+        GENSYN_STR_CAST("Mixer"),
+        GENSYN_STR_CAST("Adds up to 64 gates together, each scaled by its own gain, then by the volume. The output is not normalized."),
+
+        1,
+        mixer__on_create,
+        mixer__on_update,
+        mixer__on_remove,
+        NULL,
+
+        GENSYN_GATE__PROPERTY__CONNECTION_ARRAY, GENSYN_STR_CAST("input"), MIXER__INPUTS,
+
+        GENSYN_GATE__PROPERTY__PARAM,       GENSYN_STR_CAST("volume"), 1.0,
+        GENSYN_GATE__PROPERTY__PARAM_ARRAY, GENSYN_STR_CAST("gain"), MIXER__INPUTS, 1.0,
+        GENSYN_GATE__PROPERTY__END
+    );
+}
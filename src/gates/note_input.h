@@ -0,0 +1,121 @@
+// parameter handles, in registration order.
+enum {
+    NOTE_INPUT__PARAM__SIGNAL,
+    NOTE_INPUT__PARAM__CHANNEL
+};
+
+// values of the signal parameter
+enum {
+    NOTE_INPUT__SIGNAL__PITCH,
+    NOTE_INPUT__SIGNAL__VELOCITY,
+    NOTE_INPUT__SIGNAL__GATE
+};
+
+
+typedef struct {
+    // the last note played
+    int note;
+    float velocity;
+
+    // whether the last note is still held
+    int held;
+} note_input__data_t;
+
+
+static void * note_input__on_create(gensyn_gate_t * g) {
+    note_input__data_t * data = gensyn_gate_get_data(g);
+    data->note = 69;
+    return data;
+}
+
+
+static float note_input__value(const note_input__data_t * data, int signal) {
+    switch(signal) {
+      case NOTE_INPUT__SIGNAL__VELOCITY:
+        return data->held ? data->velocity : 0.f;
+      case NOTE_INPUT__SIGNAL__GATE:
+        return data->held;
+      default:
+        return gensyn_pitch_hz_to_sample(440.0 * pow(2.0, (data->note - 69) / 12.0));
+    }
+}
+
+
+static void note_input__apply(note_input__data_t * data, const gensyn_system__input_event_t * ev, int channel) {
+    if (ev->input > 0xff) return;
+    if (channel && (ev->input & 0x0f) + 1 != channel) return;
+
+    switch(ev->input & 0xf0) {
+      case 0x90:
+        if (ev->inputData2) {
+            data->note = ev->inputData1;
+            data->velocity = ev->inputData2 / 127.f;
+            data->held = 1;
+            break;
+        }
+        // note on with no velocity is a note off
+      case 0x80:
+        if (ev->inputData1 == data->note) data->held = 0;
+        break;
+
+      case 0xb0:
+        // all notes off and all sound off
+        if (ev->inputData1 == 123 || ev->inputData1 == 120) data->held = 0;
+        break;
+    }
+}
+
+
+static int note_input__on_update(
+    gensyn_gate_t *     gate,
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    note_input__data_t * data = userData;
+    int signal  = gensyn_gate_get_parameter_by_handle(gate, NOTE_INPUT__PARAM__SIGNAL);
+    int channel = gensyn_gate_get_parameter_by_handle(gate, NOTE_INPUT__PARAM__CHANNEL);
+
+    // the value only changes on events.
+    if (!eventCount) return gensyn_gate_output_constant(gate, note_input__value(data, signal));
+
+    // the value changes on the exact sample of each event
+    uint32_t start = 0;
+    uint32_t i;
+    for(i = 0; i < eventCount; ++i) {
+        gensyn_vector_fill(buffer+start, note_input__value(data, signal), events[i].offset - start);
+        note_input__apply(data, &events[i].event, channel);
+        start = events[i].offset;
+    }
+    gensyn_vector_fill(buffer+start, note_input__value(data, signal), sampleCount - start);
+    return 1;
+}
+
+static void note_input__on_remove(gensyn_gate_t * g, void * data) {
+}
+
+
+void gensyn_gate_add__note_input(gensyn_t * ctx) {
+    gensyn_gate_register(
+        ctx,
+        GENSYN_STR_CAST("Note_Input"),
+        GENSYN_STR_CAST("Follows incoming MIDI notes. Outputs the pitch of the last note (signal 0), its velocity while held (signal 1) or 1 while it is held (signal 2)."),
+
+        1,
+        note_input__on_create,
+        note_input__on_update,
+        note_input__on_remove,
+        NULL,
+
+
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("signal"),  0.0,
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("channel"), 0.0,
+        GENSYN_GATE__PROPERTY__DATA_SIZE, sizeof(note_input__data_t),
+        GENSYN_GATE__PROPERTY__END
+    );
+}
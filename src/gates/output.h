@@ -9,6 +9,8 @@ static int gensyn_output__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
@@ -16,11 +18,14 @@ static int gensyn_output__on_update(
 ) {
     if (!inSampleBuffers[0]) {
         // missing input! nothing to write to device...
-        printf("No input. Nothing to do!\n");
         return 0;
     }
 
-    printf("output @ %d samples, %.2f Hz\n", sampleCount, sampleRate);
+    float value;
+    if (gensyn_gate_get_in_constant(gate, 0, &value)) {
+        return gensyn_gate_output_constant(gate, value);
+    }
+
     memcpy(buffer, inSampleBuffers[0], sizeof(gensyn_sample_t)*sampleCount);
     return 1;
 }
@@ -30,8 +35,9 @@ static void gensyn_output__on_remove(gensyn_gate_t * g, void * userData) {
 }
 
 
-void gensyn_gate_add__gensyn_output() {
+void gensyn_gate_add__gensyn_output(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("GenSyn_Output"),
         GENSYN_STR_CAST("Acts as the symbolic receiver of the waveform. The recevied waveform is then passed to the device to be output as raw audio. As such, this is the endpoint for the synth."),
 
@@ -0,0 +1,74 @@
+// parameter handles, in registration order.
+enum {
+    PAN__PARAM__POSITION,
+    PAN__PARAM__SIDE
+};
+
+// values of the side parameter
+enum {
+    PAN__SIDE__LEFT,
+    PAN__SIDE__RIGHT
+};
+
+
+static void * pan__on_create(gensyn_gate_t * g) {
+    return NULL;
+}
+
+static int pan__on_update(
+    gensyn_gate_t *     gate, 
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    if (!inSampleBuffers[0]) return 0;
+    float position = gensyn_gate_get_parameter_by_handle(gate, PAN__PARAM__POSITION);
+    int   side     = gensyn_gate_get_parameter_by_handle(gate, PAN__PARAM__SIDE);
+    if (position < -1.f) position = -1.f;
+    if (position >  1.f) position =  1.f;
+
+    // equal power, so the source is as loud in the 
+    // middle as it is all the way to one side.
+    float angle = (position + 1.f) * 0.785398163f;
+    float gain = side == PAN__SIDE__RIGHT ? sinf(angle) : cosf(angle);
+    if (gain < 1e-6f) return 0;
+
+    float value;
+    if (gensyn_gate_get_in_constant(gate, 0, &value)) {
+        return gensyn_gate_output_constant(gate, value * gain);
+    }
+
+    gensyn_vector_scale(buffer, inSampleBuffers[0], gain, sampleCount);
+    return 1;
+}
+
+static void pan__on_remove(gensyn_gate_t * g, void * userData) {
+    
+}
+
+
+void gensyn_gate_add__pan(gensyn_t * ctx) {
+    gensyn_gate_register(
+        ctx,
+        GENSYN_STR_CAST("Pan"),
+        GENSYN_STR_CAST("Gives one side of the input placed between two channels. The position goes from -1 (left) to 1 (right). Side 0 gives the left channel and side 1 the right, so a pair of Pan gates with the same position feeds a pair of outputs."),
+
+        1,
+        pan__on_create,
+        pan__on_update,
+        pan__on_remove,
+        NULL,
+        
+        
+        GENSYN_GATE__PROPERTY__CONNECTION,  GENSYN_STR_CAST("input"),
+        GENSYN_GATE__PROPERTY__PARAM,       GENSYN_STR_CAST("position"),  0.0,
+        GENSYN_GATE__PROPERTY__PARAM,       GENSYN_STR_CAST("side"),      0.0,
+
+        GENSYN_GATE__PROPERTY__END
+    );
+}
@@ -1,6 +1,12 @@
 
 
 
+// parameter handles, in registration order.
+enum {
+    SIMPLE_INPUT__PARAM__VALUE
+};
+
+
 static void * simple_input__on_create(gensyn_gate_t * g) {
     return NULL;
 }
@@ -9,17 +15,15 @@ static int simple_input__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
     void *              userData
 ) {
-    float val = gensyn_gate_get_parameter(gate, GENSYN_STR_CAST("value"));
-    uint32_t i;
-    for(i = 0; i < sampleCount; ++i) {
-        buffer[i] = val;
-    }
-    return 1;
+    float val = gensyn_gate_get_parameter_by_handle(gate, SIMPLE_INPUT__PARAM__VALUE);
+    return gensyn_gate_output_constant(gate, val);
 }
 
 static void simple_input__on_remove(gensyn_gate_t * g, void * data) {
@@ -27,8 +31,9 @@ static void simple_input__on_remove(gensyn_gate_t * g, void * data) {
 }
 
 
-void gensyn_gate_add__simple_input() {
+void gensyn_gate_add__simple_input(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Simple_Input"),
         GENSYN_STR_CAST("Provides a simple, static value."),
 
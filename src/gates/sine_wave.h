@@ -3,19 +3,21 @@
 
 
 typedef struct {
-    float lastFreq;
-    float lastSample;
-    uint64_t sampleTrack;    
+    gensyn_oscillator_t osc;
 } sine_wave__data_t;
 
 static void * sine_wave__on_create(gensyn_gate_t * g) {
-    return calloc(1, sizeof(sine_wave__data_t));
+    sine_wave__data_t * data = gensyn_gate_get_data(g);
+    gensyn_oscillator_init(&data->osc, GENSYN_OSCILLATOR__SHAPE__SINE);
+    return data;
 }
 
 static int sine_wave__on_update(
     gensyn_gate_t *     gate, 
     int                 nIn,
     gensyn_sample_t **  inSampleBuffers, 
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
     gensyn_sample_t *   buffer,
     uint32_t            sampleCount,
     float               sampleRate,
@@ -23,67 +25,62 @@ static int sine_wave__on_update(
 ) {
 
     gensyn_sample_t * pitch = inSampleBuffers[0];
-    gensyn_sample_t * phase = inSampleBuffers[1];
-    gensyn_sample_t * velocity = inSampleBuffers[2];
+    gensyn_sample_t * velocity = inSampleBuffers[1];
+    gensyn_sample_t * phase = inSampleBuffers[2];
     
     uint32_t i;
     sine_wave__data_t * src = dataSrc;
     
-    printf("@ %f\n", gensyn_pitch_sample_to_hz(pitch[0]));
-    
-    if (pitch && phase){
-        /*
-        for(i = 0; i < sampleCount; ++i) {
-            buffer[i] = sin(
-                2 * M_PI * (// rads -> 1.0 per cycle
-
-                    phase[i] + // offset in seconds
-                    
-                    (gensyn_pitch_sample_to_hz(pitch[i])) * // 1.0 cycle -> number of cycles per second,
-                    
-                    ((i+sampleOffset) / sampleRate)  // progress of the cycle
-                )
-                
-            )*.5 + .5;
-        }*/
-    } else if (pitch) {
+    if (!pitch) return 0;
+
+    float constantPitch;
+    float constantVelocity;
+    int velocityIsConstant = velocity && gensyn_gate_get_in_constant(gate, 1, &constantVelocity);
+
+    // nothing to hear. The phase holds still until the velocity returns.
+    if (velocityIsConstant && constantVelocity == 0) return 0;
+
+    if (!phase && gensyn_gate_get_in_constant(gate, 0, &constantPitch)) {
+        gensyn_oscillator_run(
+            &src->osc,
+            buffer,
+            sampleCount,
+            gensyn_pitch_sample_to_hz(constantPitch),
+            sampleRate
+        );
+    } else {
+        // the phase accumulator keeps the wave continuous, so the 
+        // frequency can follow the pitch on every sample.
         for(i = 0; i < sampleCount; ++i) {
-            buffer[i] = sin( 
-                2 * M_PI * (// rads -> 1.0 per cycle
-                    
-                    (src->lastFreq) * // 1.0 cycle -> number of cycles per second,
-                    
-                    ((src->sampleTrack) / sampleRate)  // progress of the cycle
-                )
-            );
-            
-            // we only want to allow frequency shifts when we are not midway through a cycle
-            if (src->lastSample <= 0 && buffer[i] >= 0) {
-                src->sampleTrack = 0;
-                src->lastFreq = (gensyn_pitch_sample_to_hz(pitch[i]));
-            }
-            src->sampleTrack++;
-            src->lastSample = buffer[i];
-        }         
-    } else 
-        return 0;
-    
+            buffer[i] = gensyn_pitch_sample_to_hz(pitch[i]);
+        }
+        gensyn_oscillator_run_modulated(
+            &src->osc,
+            buffer,
+            buffer,
+            phase,
+            sampleCount,
+            sampleRate
+        );
+    }
     
-    if (velocity) {
-        for(i = 0; i < sampleCount; ++i) {
-            buffer[i]*=velocity[i];
+    if (velocityIsConstant) {
+        if (constantVelocity != 1) {
+            gensyn_vector_scale(buffer, buffer, constantVelocity, sampleCount);
         }
+    } else if (velocity) {
+        gensyn_vector_multiply(buffer, velocity, sampleCount);
     }
     return 1;
 }
 
 static void sine_wave__on_remove(gensyn_gate_t * g, void * data) {
-    free(data);
 }
 
 
-void gensyn_gate_add__sine_wave() {
+void gensyn_gate_add__sine_wave(gensyn_t * ctx) {
     gensyn_gate_register(
+        ctx,
         GENSYN_STR_CAST("Sine_Wave"),
         GENSYN_STR_CAST("Outputs a simple sine wave"),
 
@@ -99,6 +96,7 @@ void gensyn_gate_add__sine_wave() {
         GENSYN_GATE__PROPERTY__CONNECTION, GENSYN_STR_CAST("phase"),
 
 
+        GENSYN_GATE__PROPERTY__DATA_SIZE, sizeof(sine_wave__data_t),
         GENSYN_GATE__PROPERTY__END
     );
     
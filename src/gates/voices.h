@@ -0,0 +1,138 @@
+// parameter handles, in registration order.
+enum {
+    VOICES__PARAM__STEAL,
+    VOICES__PARAM__CHANNEL,
+    VOICES__PARAM__RELEASE,
+    VOICES__PARAM__VOLUME
+};
+
+
+// Each call to voices__set clears out the retired voices before 
+// giving new ones, so at most two can be waiting: the ones replaced 
+// by the set voices, and the ones replaced by voices from a set 
+// that raced with the clearing.
+#define VOICES__RETIRED_SLOTS 2
+
+typedef struct {
+    // voices set from another thread, not yet picked up by the update.
+    _Atomic(gensyn_voices_t *) next;
+
+    // voices being run. Only used by the update.
+    gensyn_voices_t * current;
+
+    // voices replaced by the update, which the next call 
+    // to voices__set destroys. Only the update fills a slot 
+    // and only voices__set empties one.
+    _Atomic(gensyn_voices_t *) retired[VOICES__RETIRED_SLOTS];
+} voices__data_t;
+
+
+static void * voices__on_create(gensyn_gate_t * g) {
+    return gensyn_gate_get_data(g);
+}
+
+
+// Gives the gate new voices to run in place of its current ones.
+// The gate takes ownership of them.
+static void voices__set(gensyn_gate_t * gate, gensyn_voices_t * voices) {
+    voices__data_t * data = gensyn_gate_get_data(gate);
+    gensyn_voices_t * old;
+    int i;
+    for(i = 0; i < VOICES__RETIRED_SLOTS; ++i) {
+        old = atomic_exchange(data->retired+i, NULL);
+        if (old) gensyn_voices_destroy(old);
+    }
+
+    // never picked up
+    old = atomic_exchange(&data->next, voices);
+    if (old) gensyn_voices_destroy(old);
+}
+
+
+// Picks up voices given by voices__set, if any. The current voices 
+// are only replaced once there is a slot to retire them to, so that 
+// none are lost.
+static void voices__pick_up(voices__data_t * data) {
+    if (!atomic_load(&data->next)) return;
+
+    int slot = -1;
+    if (data->current) {
+        int i;
+        for(i = 0; i < VOICES__RETIRED_SLOTS && slot < 0; ++i) {
+            if (!atomic_load(data->retired+i)) slot = i;
+        }
+        if (slot < 0) return;
+    }
+
+    gensyn_voices_t * next = atomic_exchange(&data->next, NULL);
+    if (!next) return;
+
+    // the old voices are not touched after this, so they can
+    // be destroyed from the other thread.
+    if (data->current) atomic_store(data->retired+slot, data->current);
+    data->current = next;
+}
+
+
+static int voices__on_update(
+    gensyn_gate_t *     gate,
+    int                 nIn,
+    gensyn_sample_t **  inSampleBuffers,
+    const gensyn_gate_event_t * events,
+    uint32_t            eventCount,
+    gensyn_sample_t *   buffer,
+    uint32_t            sampleCount,
+    float               sampleRate,
+    void *              userData
+) {
+    voices__data_t * data = userData;
+    voices__pick_up(data);
+
+    // silent gates are filled by the caller only when needed,
+    // so an idle gate costs nothing past this.
+    gensyn_voices_t * voices = data->current;
+    if (!voices) return 0;
+
+    gensyn_voices_set_steal(voices, gensyn_gate_get_parameter_by_handle(gate, VOICES__PARAM__STEAL));
+    gensyn_voices_set_channel(voices, gensyn_gate_get_parameter_by_handle(gate, VOICES__PARAM__CHANNEL));
+    gensyn_voices_set_release(voices, gensyn_gate_get_parameter_by_handle(gate, VOICES__PARAM__RELEASE));
+    gensyn_voices_run(voices, events, eventCount, buffer, sampleCount, sampleRate);
+    if (!gensyn_voices_get_active_count(voices)) return 0;
+
+    gensyn_vector_scale(buffer, buffer, gensyn_gate_get_parameter_by_handle(gate, VOICES__PARAM__VOLUME), sampleCount);
+    return 1;
+}
+
+static void voices__on_remove(gensyn_gate_t * g, void * userData) {
+    voices__data_t * data = userData;
+    if (data->current) gensyn_voices_destroy(data->current);
+    if (data->next)    gensyn_voices_destroy(data->next);
+    int i;
+    for(i = 0; i < VOICES__RETIRED_SLOTS; ++i) {
+        if (data->retired[i]) gensyn_voices_destroy(data->retired[i]);
+    }
+}
+
+
+void gensyn_gate_add__voices(gensyn_t * ctx) {
+    gensyn_gate_register(
+        ctx,
+        GENSYN_STR_CAST("Voices"),
+        GENSYN_STR_CAST("Plays MIDI notes polyphonically with copies of a template circuit. See setTemplate."),
+
+        1,
+        voices__on_create,
+        voices__on_update,
+        voices__on_remove,
+        NULL,
+
+
+        // see gensyn_voices__steal_e
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("steal"),   0.0,
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("channel"), 0.0,
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("release"), 1.0,
+        GENSYN_GATE__PROPERTY__PARAM, GENSYN_STR_CAST("volume"),  0.25,
+        GENSYN_GATE__PROPERTY__DATA_SIZE, sizeof(voices__data_t),
+        GENSYN_GATE__PROPERTY__END
+    );
+}
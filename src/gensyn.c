@@ -4,6 +4,11 @@
 #include <gensyn/sample.h>
 #include <gensyn/system.h>
 #include <gensyn/ring.h>
+#include <gensyn/pool.h>
+#include <gensyn/oscillator.h>
+#include <gensyn/vector.h>
+#include <gensyn/voices.h>
+#include <stdatomic.h>
 #include "extern/duktape.h"
 #include "extern/srgs.h"
 
@@ -16,10 +21,64 @@
 #include "gates/adder.h"
 #include "gates/lfo.h"
 #include "gates/glider.h"
+#include "gates/amplifier.h"
+#include "gates/note_input.h"
+#include "gates/voices.h"
+#include "gates/mixer.h"
+#include "gates/pan.h"
 ///////
+
+
+// Most input events given to the gates in one block. 
+// Any more wait for the next block.
+#define MAX_BLOCK_EVENTS 256
+
+// How slowly the predicted block time follows the 
+// actual time that blocks are generated.
+#define BLOCK_TIME_SMOOTHING 64
+
+// Whether circuit number a was published before b.
+// Numbers are compared so that they can wrap around.
+#define CIRCUIT_BEFORE(__a__, __b__) ((int32_t)((__a__) - (__b__)) < 0)
+
+
+
+// A compiled circuit, handed from the thread editing the 
+// circuit to the thread generating the waveform.
+typedef struct {
+    gensyn_gate_plan_t * plan;
+
+    // circuits are numbered in the order they are published, from 1.
+    uint32_t seq;
+} gensyn__circuit_t;
+
+
+// Kinds of objects waiting to be freed.
+typedef enum {
+    GENSYN__RETIRED__GATE,
+    GENSYN__RETIRED__POOL
+} gensyn__retired_e;
+
+
+// An object that the thread generating the waveform may still 
+// be using, which is freed once it cannot be.
+typedef struct {
+    gensyn__retired_e type;
+    void * object;
+
+    // freed once the circuit being run is at least this one.
+    uint32_t seq;
+
+    // freed once the input thread has dropped this many gates, 
+    // so that it is no longer sending the gate events.
+    uint32_t inputRemoves;
+} gensyn__retired_t;
+
  
 struct gensyn_t {
-    gensyn_gate_t * output;
+    // the output gate of each channel. 
+    gensyn_gate_t ** outputs;
+    uint32_t channelCount;
 
     gensyn_table_t * gates;
     gensyn_table_t * fnCmd;
@@ -43,16 +102,103 @@ struct gensyn_t {
     
     // all gates that accept 
     gensyn_array_t * inputGates;
+
+    // input events sent from the input thread to 
+    // the thread generating the waveform.
+    gensyn_ring_t * events;
+
+    // the events for the block being generated, sorted by offset.
+    gensyn_gate_event_t blockEvents[MAX_BLOCK_EVENTS];
+
+    // when the last block was generated, as from gensyn_system_get_time.
+    uint64_t blockTime;
+
+    // Edits are made to the gates directly, then compiled into a new 
+    // circuit when published. The thread generating the waveform picks 
+    // up the newest circuit at the start of a block, so it never sees 
+    // an edit halfway. Gates, plans and pools that older circuits used 
+    // are kept until that thread has moved on to a newer one.
+
+    // the newest circuit published and not yet picked up.
+    _Atomic(gensyn__circuit_t *) nextCircuit;
+
+    // the circuit being run. Only used by the thread generating the waveform.
+    gensyn__circuit_t * circuit;
+
+    // number of the circuit being run. Only set once the 
+    // circuit before it is no longer being used.
+    _Atomic uint32_t runSeq;
+
+    // the rest is only used by the thread editing the circuit.
+
+    // whether the circuit was edited since it was last published.
+    int circuitChanged;
+
+    // number of the newest circuit published.
+    uint32_t publishSeq;
+
+    // of type gensyn__circuit_t *. Circuits that have been published 
+    // and may still be run, and old circuits to compile into again.
+    gensyn_array_t * circuits;
+    gensyn_array_t * spareCircuits;
+
+    // of type gensyn__retired_t.
+    gensyn_array_t * retired;
+
+    // whether the device may be generating the waveform. Before that, 
+    // circuits are picked up as soon as they are published.
+    int audioStarted;
+
+    // workers that run the plan. NULL if no workers are requested.
+    gensyn_pool_t * pool;
+    uint32_t workerCount;
+
+    // gates sent to the input thread to be dropped, 
+    // and how many of them it has dropped.
+    uint32_t inputRemovesSent;
+
+    // of type gensyn__retired_t. Gates to be dropped by the input 
+    // thread that did not fit in commandRemove yet. They are 
+    // only retired once they have been sent.
+    gensyn_array_t * pendingRemoves;
+    _Atomic uint32_t inputRemovesDone;
+
+    // of type gensyn_gate_t *. Gates that read input that did 
+    // not fit in commandAdd yet, in the order they were made.
+    gensyn_array_t * pendingAdds;
+
+    // gate types usable in this context.
+    gensyn_gate_registry_t * registry;
+
+    // set to stop the input loop, which clears inputRunning once stopped.
+    _Atomic int inputQuit;
+    _Atomic int inputRunning;
+
+    // what the context was created with.
+    gensyn_create_options_t options;
 };
 
-static gensyn_table_t * ecmaToInstance = NULL;
 
 // Starts the input loop for the system.
 void gensyn_start_input_loop(gensyn_t * t);
 
 
 // Registers all built-in gate types.
-static void register_gate_types();
+static void register_gate_types(gensyn_t *);
+
+// Keeps an object until the thread generating the 
+// waveform can no longer be using it, then frees it.
+static void gensyn_retire(gensyn_t *, gensyn__retired_e, void *);
+
+// Sends new gates that read input to the input thread.
+static void gensyn_send_adds(gensyn_t *);
+
+// Sends gates waiting to be dropped to the input thread.
+static void gensyn_send_removes(gensyn_t *);
+
+// Generates a block with the circuit that was last published, 
+// without publishing. Used by the device's thread.
+static void gensyn_run_circuit(gensyn_t *, gensyn_sample_t **, uint32_t, float);
 
 
  
@@ -91,6 +237,14 @@ const char * initialjs =
 "                    },\n"
 "                    'getParam' : function(paramName) {\n"
 "                        return Number.parse(__gensyn_c_native('gate-get-param', gateName, paramName));\n"
+"                    },\n"
+                     // for Voices gates: plays notes with voiceCount copies of the 
+                     // circuit that ends at templateGateObject.
+"                    'setTemplate' : function(templateGateObject, voiceCount) {\n"
+"                        var result = __gensyn_c_native('gate-set-template', gateName, templateGateObject.name, voiceCount);\n"
+"                        if (result != '') {\n"
+"                            throw new Error(result);\n"
+"                        }\n"
 "                    },\n"
 "                }\n"
 "            },\n"
@@ -108,9 +262,10 @@ const char * initialjs =
 "        loadState : function(state) {\n"
 "            throw new Error('Havent implemented this yet');\n"
 "        },\n"
-        // returns the default output object that will receive the waveform
-"        getOutput : function() {\n"
-"            return this.gate.get('output');\n"
+        // returns the output object that will receive the waveform of the 
+        // given channel, or the first channel if none is given.
+"        getOutput : function(channel) {\n"
+"            return this.gate.get(channel ? 'output' + channel : 'output');\n"
 "        },\n"
 "        help : function() {\n"
 "            return __gensyn_c_native('help');\n"
@@ -283,7 +438,9 @@ const char * initialjs =
 "            'B8'  : 1.0,\n" 
 "        }\n"
 "    }\n"
-"})();\n";
+"})();\n"
+// evaluates to the empty string, so that only errors are printed on creation.
+"'';\n";
 
 
 
@@ -324,6 +481,11 @@ static void gensyn_command__gate_check(gensyn_t *, gensyn_string_t **, int, gens
 //      If successful, will return an empty string.
 static void gensyn_command__gate_add(gensyn_t *, gensyn_string_t **, int, gensyn_string_t *);
 
+// gate-remove nameOfGate
+//  -   Removes the gate with the given name, disconnecting it from 
+//      the rest. If successful, returns the empty string.
+static void gensyn_command__gate_remove(gensyn_t *, gensyn_string_t **, int, gensyn_string_t *);
+
 // gate-summary idForGate
 //  -   Gives a detailed summary of a gate 
 // 
@@ -348,13 +510,50 @@ static void gensyn_command__gate_get_param(gensyn_t *, gensyn_string_t **, int,
 //  -   sets the given parameter value 
 static void gensyn_command__gate_set_param(gensyn_t *, gensyn_string_t **, int, gensyn_string_t *);
 
+// gate-set-template voicesGateID templateGateID voiceCount
+//  -   gives a Voices gate voiceCount copies of the circuit connected to 
+//      the template gate. If successful, returns the empty string.
+static void gensyn_command__gate_set_template(gensyn_t *, gensyn_string_t **, int, gensyn_string_t *);
+
 
 // runs the given command
 static void gensyn_command_run_internal(gensyn_t *, gensyn_string_t **, int, gensyn_string_t *);
 
+// Returns the ECMA context, creating it and running the 
+// initial script the first time it is needed.
+static duk_context * gensyn_get_ecma(gensyn_t *);
+
+
+void gensyn_create_options_init(gensyn_create_options_t * options) {
+    options->inputLoop = 1;
+    options->probeDevices = 1;
+    options->audio = 1;
+    options->channels = 1;
+}
+
 
 gensyn_t * gensyn_create() {
+    return gensyn_create_with_options(NULL);
+}
+
+gensyn_t * gensyn_create_headless() {
+    gensyn_create_options_t options;
+    options.inputLoop = 0;
+    options.probeDevices = 0;
+    options.audio = 0;
+    options.channels = 1;
+    return gensyn_create_with_options(&options);
+}
+
+
+gensyn_t * gensyn_create_with_options(const gensyn_create_options_t * options) {
+    gensyn_vector_init();
     gensyn_t * out = calloc(1, sizeof(gensyn_t));
+    if (options) {
+        out->options = *options;
+    } else {
+        gensyn_create_options_init(&out->options);
+    }
     out->gates = gensyn_table_create_hash_gensyn_string();
     out->fnCmd = gensyn_table_create_hash_gensyn_string();
     out->result = gensyn_string_create();
@@ -365,53 +564,184 @@ gensyn_t * gensyn_create() {
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-list"),      gensyn_command__gate_list);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-check"),     gensyn_command__gate_check);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-add"),       gensyn_command__gate_add);
+    gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-remove"),    gensyn_command__gate_remove);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-summary"),   gensyn_command__gate_summary);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-connect"),   gensyn_command__gate_connect);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-disconnect"),gensyn_command__gate_disconnect);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-get-param"), gensyn_command__gate_get_param);
     gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-set-param"), gensyn_command__gate_set_param);
+    gensyn_table_insert(out->fnCmd, GENSYN_STR_CAST("gate-set-template"), gensyn_command__gate_set_template);
 
     
     out->tableIter = gensyn_table_iter_create();
-    out->ecma = duk_create_heap(NULL, NULL, NULL, out, gensyn_ecma_c_err_handler);
-    duk_push_c_function(out->ecma, gensyn_ecma_c_native, DUK_VARARGS);
-    duk_put_global_string(out->ecma, "__gensyn_c_native");
+    out->commandAdd    = gensyn_ring_create(sizeof(gensyn_gate_t*), 1024);
+    out->commandRemove = gensyn_ring_create(sizeof(gensyn_gate_t*), 1024);
+    out->events        = gensyn_ring_create(sizeof(gensyn_system__input_event_t), 1024);
+    out->circuits      = gensyn_array_create(sizeof(gensyn__circuit_t *));
+    out->spareCircuits = gensyn_array_create(sizeof(gensyn__circuit_t *));
+    out->retired       = gensyn_array_create(sizeof(gensyn__retired_t));
+    out->pendingRemoves = gensyn_array_create(sizeof(gensyn__retired_t));
+    out->pendingAdds    = gensyn_array_create(sizeof(gensyn_gate_t *));
+    out->circuitChanged = 1;
 
-    if (!ecmaToInstance) {
-        ecmaToInstance = gensyn_table_create_hash_pointer();
-    }
-    gensyn_table_insert(ecmaToInstance, out->ecma, out);
-    
-    register_gate_types();
+    out->registry = gensyn_gate_registry_create();
+    register_gate_types(out);
 
     
-    out->output = gensyn_create_named_gate(
-        out, 
-        GENSYN_STR_CAST("GenSyn_Output"), 
-        GENSYN_STR_CAST("output")
-    );
-    
-    
-    const gensyn_string_t * in = gensyn_send_command(out, GENSYN_STR_CAST(initialjs));
-    if (gensyn_string_get_length(in)) {
-        printf("%s\n", gensyn_string_get_c_str(in));
+    // the first channel keeps the plain name, so 
+    // mono circuits do not need to know about channels.
+    out->channelCount = out->options.channels ? out->options.channels : 1;
+    out->outputs = malloc(out->channelCount*sizeof(gensyn_gate_t *));
+    gensyn_string_t * name = gensyn_string_create();
+    uint32_t i;
+    for(i = 0; i < out->channelCount; ++i) {
+        gensyn_string_clear(name);
+        gensyn_string_concat_printf(name, i ? "output%d" : "output", (int)i);
+        out->outputs[i] = gensyn_create_named_gate(
+            out, 
+            GENSYN_STR_CAST("GenSyn_Output"), 
+            name
+        );
     }
+    gensyn_string_destroy(name);
     
-    out->sys = gensyn_system_create();
-    
-    
-    out->commandAdd    = gensyn_ring_create(sizeof(gensyn_gate_t*), 1024);
-    out->commandRemove = gensyn_ring_create(sizeof(gensyn_gate_t*), 1024);
     out->inputGates    = gensyn_array_create(sizeof(gensyn_gate_t*));
-    
-    gensyn_start_input_loop(out);
+
+    // the system is only needed for devices
+    if (out->options.inputLoop || out->options.audio) {
+        out->sys = gensyn_system_create();
+    }
+    if (out->options.inputLoop) {
+        gensyn_start_input_loop(out);
+    }
     return out;
 }
 
+
+void gensyn_destroy(gensyn_t * g) {
+    if (atomic_load(&g->inputRunning)) {
+        atomic_store(&g->inputQuit, 1);
+        gensyn_system_input_wake(g->sys);
+        while(atomic_load(&g->inputRunning)) {
+            gensyn_system_usleep(1000);
+        }
+    }
+
+    // gates cannot be destroyed while iterating over the table
+    gensyn_array_t * gates = gensyn_array_create(sizeof(gensyn_gate_t *));
+    for(gensyn_table_iter_start(g->tableIter, g->gates);
+        !gensyn_table_iter_is_end(g->tableIter);
+        gensyn_table_iter_proceed(g->tableIter)) {
+        gensyn_gate_t * gate = gensyn_table_iter_get_value(g->tableIter);
+        gensyn_array_push(gates, gate);
+    }
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(gates); ++i) {
+        gensyn_gate_destroy(gensyn_array_at(gates, gensyn_gate_t *, i));
+    }
+    gensyn_array_destroy(gates);
+
+    // nothing is generating the waveform anymore, so 
+    // everything waiting can be freed at once.
+    for(i = 0; i < gensyn_array_get_size(g->retired); ++i) {
+        gensyn__retired_t * r = &gensyn_array_at(g->retired, gensyn__retired_t, i);
+        if (r->type == GENSYN__RETIRED__GATE) {
+            gensyn_gate_destroy(r->object);
+        } else {
+            gensyn_pool_destroy(r->object);
+        }
+    }
+    gensyn_array_destroy(g->retired);
+    for(i = 0; i < gensyn_array_get_size(g->pendingRemoves); ++i) {
+        gensyn_gate_destroy(gensyn_array_at(g->pendingRemoves, gensyn__retired_t, i).object);
+    }
+    gensyn_array_destroy(g->pendingRemoves);
+
+    // gates never sent are still named, so they were destroyed above.
+    gensyn_array_destroy(g->pendingAdds);
+    if (g->pool) {
+        gensyn_pool_destroy(g->pool);
+    }
+
+    gensyn_array_t * circuitLists[] = {g->circuits, g->spareCircuits};
+    uint32_t n;
+    for(n = 0; n < 2; ++n) {
+        for(i = 0; i < gensyn_array_get_size(circuitLists[n]); ++i) {
+            gensyn__circuit_t * c = gensyn_array_at(circuitLists[n], gensyn__circuit_t *, i);
+            gensyn_gate_plan_destroy(c->plan);
+            free(c);
+        }
+        gensyn_array_destroy(circuitLists[n]);
+    }
+    gensyn_gate_registry_destroy(g->registry);
+    if (g->ecma) {
+        duk_destroy_heap(g->ecma);
+    }
+
+    gensyn_ring_destroy(g->commandAdd);
+    gensyn_ring_destroy(g->commandRemove);
+    gensyn_ring_destroy(g->events);
+    gensyn_array_destroy(g->inputGates);
+    free(g->outputs);
+    gensyn_table_iter_destroy(g->tableIter);
+    gensyn_table_destroy(g->gates);
+    gensyn_table_destroy(g->fnCmd);
+    gensyn_string_destroy(g->result);
+    free(g);
+}
+
 void gensyn_start_audio(gensyn_t * g) {
+    gensyn_start_audio_with_options(g, NULL);
+}
+
+// Generates the device's channels from the context's. A mono circuit 
+// is played on every device channel. Otherwise, device channels past 
+// the context's are silent and context channels past the device's 
+// are generated but not played.
+static void gensyn_audio_callback(
+    void * userData,
+    gensyn_sample_t ** channels,
+    uint32_t channelCount,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    gensyn_t * g = userData;
+    gensyn_sample_t * outputs[g->channelCount];
+    uint32_t i;
+    for(i = 0; i < g->channelCount; ++i) {
+        outputs[i] = i < channelCount ? channels[i] : NULL;
+    }
+    gensyn_run_circuit(g, outputs, sampleCount, sampleRate);
+
+    for(i = g->channelCount; i < channelCount; ++i) {
+        if (g->channelCount == 1) {
+            memcpy(channels[i], channels[0], sampleCount*sizeof(gensyn_sample_t));
+        } else {
+            gensyn_vector_fill(channels[i], 0.f, sampleCount);
+        }
+    }
+}
+
+void gensyn_start_audio_with_options(gensyn_t * g, const gensyn_system_audio_options_t * optionsSrc) {
+    if (!g->options.audio) return;
+
+    // the device starts with the circuit as it is now. 
+    // From here on, it picks up circuits on its own.
+    gensyn_publish_circuit(g);
+    g->audioStarted = 1;
+
+    gensyn_system_audio_options_t options;
+    if (optionsSrc) {
+        options = *optionsSrc;
+    } else {
+        gensyn_system_audio_options_init(&options);
+    }
+    if (!options.channels) options.channels = g->channelCount;
+
     gensyn_system_setup_audio(
         g->sys,
-        gensyn_generate_waveform,
+        &options,
+        gensyn_audio_callback,
         g
     );
 }
@@ -420,17 +750,49 @@ void gensyn_start_audio(gensyn_t * g) {
 
 // Gets the main output gate.
 gensyn_gate_t * gensyn_get_output_gate(const gensyn_t * g) {
-    return (gensyn_gate_t *)g->output;
+    return g->outputs[0];
+}
+
+uint32_t gensyn_get_channel_count(const gensyn_t * g) {
+    return g->channelCount;
+}
+
+gensyn_gate_t * gensyn_get_channel_output_gate(const gensyn_t * g, uint32_t channel) {
+    return channel < g->channelCount ? g->outputs[channel] : NULL;
 }
 
 
-const gensyn_string_t * gensyn_send_command(const gensyn_t * g, const gensyn_string_t * str) {
-    duk_push_string(g->ecma, gensyn_string_get_c_str(str));
+static duk_context * gensyn_get_ecma(gensyn_t * g) {
+    if (g->ecma) return g->ecma;
+
+    // most of the startup time of a context is compiling the 
+    // initial script, so it waits until a command is actually sent.
+    g->ecma = duk_create_heap(NULL, NULL, NULL, g, gensyn_ecma_c_err_handler);
+    duk_push_c_function(g->ecma, gensyn_ecma_c_native, DUK_VARARGS);
+    duk_put_global_string(g->ecma, "__gensyn_c_native");
+
+    duk_push_string(g->ecma, initialjs);
     duk_peval(g->ecma);
-    gensyn_string_clear(g->result);
-    gensyn_string_concat_printf(g->result, "%s", duk_safe_to_string(g->ecma, -1));
+    const char * in = duk_safe_to_string(g->ecma, -1);
+    if (in[0]) {
+        printf("%s\n", in);
+    }
     duk_pop(g->ecma);
-    
+    return g->ecma;
+}
+
+
+const gensyn_string_t * gensyn_send_command(const gensyn_t * gSrc, const gensyn_string_t * str) {
+    gensyn_t * g = (gensyn_t *)gSrc;
+    duk_context * ecma = gensyn_get_ecma(g);
+    duk_push_string(ecma, gensyn_string_get_c_str(str));
+    duk_peval(ecma);
+    gensyn_string_clear(g->result);
+    gensyn_string_concat_printf(g->result, "%s", duk_safe_to_string(ecma, -1));
+    duk_pop(ecma);
+
+    // all the edits of a command take effect together.
+    gensyn_publish_circuit(g);
     return g->result;
 }
  
@@ -453,6 +815,13 @@ gensyn_gate_t * gensyn_create_named_gate(
     }
 
     gensyn_table_insert(g->gates, name, gate);
+
+    // hand the gate to the input thread, which may have to wait 
+    // for room. Without an input loop, nothing would take it.
+    if (gensyn_gate_reads_input(gate) && g->options.inputLoop) {
+        gensyn_array_push(g->pendingAdds, gate);
+        gensyn_send_adds(g);
+    }
     return gate;
 }
 
@@ -464,14 +833,281 @@ gensyn_gate_t * gensyn_get_named_gate(const gensyn_t * g, const gensyn_string_t
 
 
 
-void gensyn_destroy_named_gate(const gensyn_t * g, const gensyn_string_t * name) {
+void gensyn_destroy_named_gate(const gensyn_t * gSrc, const gensyn_string_t * name) {
+    gensyn_t * g = (gensyn_t *)gSrc;
     gensyn_gate_t * gate = gensyn_get_named_gate(g, name);
     if (!gate) {
         return;
     }
     
     gensyn_table_remove(g->gates, name);
-    gensyn_gate_destroy(gate);
+
+    // the circuit being run may still have the gate, 
+    // so it is only cut off from the rest for now.
+    gensyn_gate_disconnect_all(gate);
+    gensyn_mark_circuit_changed(g);
+
+    // a gate the input thread was never sent needs no dropping.
+    if (gensyn_gate_reads_input(gate)) {
+        uint32_t i;
+        for(i = 0; i < gensyn_array_get_size(g->pendingAdds); ++i) {
+            if (gensyn_array_at(g->pendingAdds, gensyn_gate_t *, i) == gate) {
+                gensyn_array_remove(g->pendingAdds, i);
+                gensyn_retire(g, GENSYN__RETIRED__GATE, gate);
+                return;
+            }
+        }
+    }
+
+    // the input thread may be sending it events until it is told 
+    // to drop the gate, which may have to wait for room.
+    if (gensyn_gate_reads_input(gate) && atomic_load(&g->inputRunning)) {
+        gensyn__retired_t r;
+        r.type = GENSYN__RETIRED__GATE;
+        r.object = gate;
+        r.seq = g->publishSeq + 1;
+        r.inputRemoves = 0;
+        gensyn_array_push(g->pendingRemoves, r);
+        gensyn_send_removes(g);
+    } else {
+        gensyn_retire(g, GENSYN__RETIRED__GATE, gate);
+    }
+}
+
+
+void gensyn_mark_circuit_changed(gensyn_t * g) {
+    g->circuitChanged = 1;
+}
+
+
+static void gensyn_retire(gensyn_t * g, gensyn__retired_e type, void * object) {
+    gensyn__retired_t r;
+    r.type = type;
+    r.object = object;
+
+    // the next circuit published is the first without it.
+    r.seq = g->publishSeq + 1;
+    r.inputRemoves = g->inputRemovesSent;
+    gensyn_array_push(g->retired, r);
+}
+
+
+// Sends the input thread as many of the new gates as there 
+// is room for. Always before any removes, so that a gate is 
+// never dropped before it was added.
+static void gensyn_send_adds(gensyn_t * g) {
+    uint32_t count = gensyn_array_get_size(g->pendingAdds);
+    if (!count) return;
+    uint32_t sent = gensyn_ring_push_n(g->commandAdd, gensyn_array_get_data(g->pendingAdds), count);
+    if (!sent) return;
+
+    uint32_t i;
+    for(i = sent; i < count; ++i) {
+        gensyn_array_at(g->pendingAdds, gensyn_gate_t *, i-sent) = 
+            gensyn_array_at(g->pendingAdds, gensyn_gate_t *, i);
+    }
+    gensyn_array_set_size(g->pendingAdds, count-sent);
+    if (g->sys) gensyn_system_input_wake(g->sys);
+}
+
+
+// Sends the input thread as many of the gates waiting to be dropped 
+// as there is room for, and retires the ones sent.
+static void gensyn_send_removes(gensyn_t * g) {
+    uint32_t sent = 0;
+    uint32_t count = gensyn_array_get_size(g->pendingRemoves);
+    for(; sent < count; ++sent) {
+        // keeps the circuit number from when the gate was removed,
+        // which may have been published already.
+        gensyn__retired_t r = gensyn_array_at(g->pendingRemoves, gensyn__retired_t, sent);
+        if (!gensyn_ring_push(g->commandRemove, r.object)) break;
+        r.inputRemoves = ++g->inputRemovesSent;
+        gensyn_array_push(g->retired, r);
+    }
+    if (!sent) return;
+
+    uint32_t i;
+    for(i = sent; i < count; ++i) {
+        gensyn_array_at(g->pendingRemoves, gensyn__retired_t, i-sent) = 
+            gensyn_array_at(g->pendingRemoves, gensyn__retired_t, i);
+    }
+    gensyn_array_set_size(g->pendingRemoves, count-sent);
+    if (g->sys) gensyn_system_input_wake(g->sys);
+}
+
+
+// Frees whatever the thread generating the waveform has moved past,
+// and keeps the circuits it has moved past for compiling into again.
+static void gensyn_reclaim(gensyn_t * g) {
+    uint32_t runSeq = atomic_load(&g->runSeq);
+    uint32_t inputRemovesDone = atomic_load(&g->inputRemovesDone);
+    int inputRunning = atomic_load(&g->inputRunning);
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(g->circuits);) {
+        gensyn__circuit_t * c = gensyn_array_at(g->circuits, gensyn__circuit_t *, i);
+        if (CIRCUIT_BEFORE(c->seq, runSeq)) {
+            gensyn_array_remove(g->circuits, i);
+            gensyn_array_push(g->spareCircuits, c);
+        } else {
+            ++i;
+        }
+    }
+
+    for(i = 0; i < gensyn_array_get_size(g->retired);) {
+        gensyn__retired_t r = gensyn_array_at(g->retired, gensyn__retired_t, i);
+        if (CIRCUIT_BEFORE(runSeq, r.seq) || 
+            (inputRunning && CIRCUIT_BEFORE(inputRemovesDone, r.inputRemoves))) {
+            ++i;
+            continue;
+        }
+        gensyn_array_remove(g->retired, i);
+        if (r.type == GENSYN__RETIRED__GATE) {
+            gensyn_gate_destroy(r.object);
+        } else {
+            gensyn_pool_destroy(r.object);
+        }
+    }
+}
+
+
+// Switches to the newest circuit published, if there is one. 
+// Only called by the thread generating the waveform, between blocks.
+static void gensyn_pick_up_circuit(gensyn_t * g) {
+    gensyn__circuit_t * next = atomic_exchange(&g->nextCircuit, NULL);
+    if (!next) return;
+
+    // gates that are no longer part of the circuit 
+    // will not be run, so they stay inactive.
+    if (g->circuit) {
+        uint32_t i;
+        uint32_t count = gensyn_gate_plan_get_gate_count(g->circuit->plan);
+        for(i = 0; i < count; ++i) {
+            gensyn_gate_reset_is_active(gensyn_gate_plan_get_gate(g->circuit->plan, i));
+        }
+    }
+    g->circuit = next;
+
+    // the old circuit is not touched after this.
+    atomic_store(&g->runSeq, next->seq);
+}
+
+
+void gensyn_publish_circuit(gensyn_t * g) {
+    if (g->circuitChanged) {
+        g->circuitChanged = 0;
+
+        // circuits using the old pool keep it until they are done.
+        if (g->workerCount != (g->pool ? gensyn_pool_get_worker_count(g->pool) : 0)) {
+            if (g->pool) gensyn_retire(g, GENSYN__RETIRED__POOL, g->pool);
+            g->pool = g->workerCount ? gensyn_pool_create(g->workerCount) : NULL;
+        }
+
+        gensyn__circuit_t * c;
+        uint32_t spares = gensyn_array_get_size(g->spareCircuits);
+        if (spares) {
+            c = gensyn_array_at(g->spareCircuits, gensyn__circuit_t *, spares-1);
+            gensyn_array_set_size(g->spareCircuits, spares-1);
+        } else {
+            c = calloc(1, sizeof(gensyn__circuit_t));
+            c->plan = gensyn_gate_plan_create();
+        }
+        gensyn_gate_plan_compile_outputs(c->plan, g->outputs, g->channelCount);
+        gensyn_gate_plan_set_pool(c->plan, g->pool);
+        c->seq = ++g->publishSeq;
+        gensyn_array_push(g->circuits, c);
+
+        // a circuit replaced before it was picked up was never run.
+        gensyn__circuit_t * old = atomic_exchange(&g->nextCircuit, c);
+        if (old) {
+            uint32_t i;
+            for(i = 0; i < gensyn_array_get_size(g->circuits); ++i) {
+                if (gensyn_array_at(g->circuits, gensyn__circuit_t *, i) == old) {
+                    gensyn_array_remove(g->circuits, i);
+                    break;
+                }
+            }
+            gensyn_array_push(g->spareCircuits, old);
+        }
+    }
+
+    // without a device, the waveform is only generated by 
+    // this thread, so there is no block to wait for.
+    if (!g->audioStarted) {
+        gensyn_pick_up_circuit(g);
+    }
+    gensyn_send_adds(g);
+    gensyn_send_removes(g);
+    gensyn_reclaim(g);
+}
+
+
+// Takes the events that arrived since the last block and places 
+// them at the matching sample in this one. Events are delivered 
+// one block late, but at a fixed delay, so they do not jitter with 
+// the point in the device's period at which they arrived.
+// Returns the number of events in blockEvents.
+// Whether the event ends notes: a note off, or all notes 
+// or all sound off. These are never dropped as stale.
+static int gensyn_is_release_event(const gensyn_system__input_event_t * ev) {
+    if (ev->input > 0xff) return 0;
+    int type = ev->input & 0xf0;
+    return type == 0x80 || 
+          (type == 0x90 && !ev->inputData2) ||
+          (type == 0xb0 && (ev->inputData1 == 123 || ev->inputData1 == 120));
+}
+
+static uint32_t gensyn_collect_block_events(
+    gensyn_t * g,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    if (!sampleCount) return 0;
+    uint64_t now = gensyn_system_get_time();
+    uint64_t last = g->blockTime;
+
+    // the time of each block is predicted from the last one, and only 
+    // slowly pulled toward when the block actually runs. This way, 
+    // jitter in when the device asks for blocks does not move the events.
+    // After a pause or a change in rate, it starts over from now.
+    int64_t period = sampleCount * (1e9 / sampleRate);
+    int64_t error = last ? (int64_t)(now - (last + period)) : 0;
+    int reset = 0;
+    if (!last || error > 4*period || error < -4*period) {
+        last = now - period;
+        error = 0;
+        reset = 1;
+    }
+    g->blockTime = last + period + error / BLOCK_TIME_SMOOTHING;
+
+    const gensyn_system__input_event_t * ev;
+    uint32_t available;
+    uint32_t count = 0;
+    while(count < MAX_BLOCK_EVENTS && (ev = gensyn_ring_peek(g->events, &available))) {
+        // events after the end of this block wait for the next one.
+        if (ev->time > g->blockTime) break;
+
+        // events that piled up while nothing was generated are 
+        // stale, apart from the ones that stop notes from hanging.
+        if (reset && ev->time < last && !gensyn_is_release_event(ev)) {
+            gensyn_ring_release(g->events, 1);
+            continue;
+        }
+
+        // events from before this block are late and land at the start.
+        double offset = ev->time > last ? (ev->time - last) * (sampleRate / 1e9) : 0;
+        if (offset > sampleCount-1) offset = sampleCount-1;
+
+        // events from different devices may be captured out of order
+        uint32_t i = count++;
+        while(i && g->blockEvents[i-1].offset > (uint32_t)offset) {
+            g->blockEvents[i] = g->blockEvents[i-1];
+            i--;
+        }
+        g->blockEvents[i].offset = offset;
+        g->blockEvents[i].event = *ev;
+        gensyn_ring_release(g->events, 1);
+    }
+    return count;
 }
 
 
@@ -481,22 +1117,54 @@ void gensyn_generate_waveform(
     uint32_t sampleCount,
     float   sampleRate
 ) {
+    gensyn_sample_t * channels[g->channelCount];
     uint32_t i;
-    
-    // reset active status.
-    // this will get updated by gate_run 
-    for(gensyn_table_iter_start(g->tableIter, g->gates);
-        !gensyn_table_iter_is_end(g->tableIter);
-        gensyn_table_iter_proceed(g->tableIter)) {
-        gensyn_gate_reset_is_active(gensyn_table_iter_get_value(g->tableIter));
+    channels[0] = samplesOut;
+    for(i = 1; i < g->channelCount; ++i) channels[i] = NULL;
+    gensyn_generate_waveform_planar(g, channels, sampleCount, sampleRate);
+}
+
+void gensyn_generate_waveform_planar(
+    gensyn_t * g, 
+    gensyn_sample_t ** channelsOut,
+    uint32_t sampleCount,
+    float   sampleRate
+) {
+    gensyn_publish_circuit(g);
+    gensyn_run_circuit(g, channelsOut, sampleCount, sampleRate);
+}
+
+
+static void gensyn_run_circuit(
+    gensyn_t * g, 
+    gensyn_sample_t ** channelsOut,
+    uint32_t sampleCount,
+    float   sampleRate
+) {
+    gensyn_pick_up_circuit(g);
+    uint32_t eventCount = gensyn_collect_block_events(g, sampleCount, sampleRate);
+
+    // nothing has been published yet.
+    if (!g->circuit) {
+        uint32_t i;
+        for(i = 0; i < g->channelCount; ++i) {
+            if (channelsOut[i]) gensyn_vector_fill(channelsOut[i], 0.f, sampleCount);
+        }
+        return;
     }
-    gensyn_gate_run(
-        gensyn_get_output_gate(g),
-        samplesOut,
+
+    gensyn_gate_plan_set_events(g->circuit->plan, g->blockEvents, eventCount);
+    gensyn_gate_plan_run_planar(
+        g->circuit->plan,
+        channelsOut,
         sampleCount,
         sampleRate
     );
+}
 
+void gensyn_set_worker_count(gensyn_t * g, uint32_t count) {
+    g->workerCount = count;
+    gensyn_mark_circuit_changed(g);
 }
 
 void gensyn_set_origin(gensyn_t * g, int x, int y) {
@@ -516,17 +1184,26 @@ gensyn_system_t * gensyn_get_system(gensyn_t * g) {
     return g->sys;
 }
 
+gensyn_gate_registry_t * gensyn_get_gate_registry(const gensyn_t * g) {
+    return g->registry;
+}
+
 
 /////////////////// statics 
 
 
-void register_gate_types() {
-    gensyn_gate_add__gensyn_output();
-    gensyn_gate_add__sine_wave();
-    gensyn_gate_add__simple_input();
-    gensyn_gate_add__lfo();
-    gensyn_gate_add__adder();
-    gensyn_gate_add__glider();
+void register_gate_types(gensyn_t * g) {
+    gensyn_gate_add__gensyn_output(g);
+    gensyn_gate_add__sine_wave(g);
+    gensyn_gate_add__simple_input(g);
+    gensyn_gate_add__lfo(g);
+    gensyn_gate_add__adder(g);
+    gensyn_gate_add__glider(g);
+    gensyn_gate_add__amplifier(g);
+    gensyn_gate_add__note_input(g);
+    gensyn_gate_add__voices(g);
+    gensyn_gate_add__mixer(g);
+    gensyn_gate_add__pan(g);
 }
 
 
@@ -534,7 +1211,10 @@ void register_gate_types() {
 static duk_ret_t gensyn_ecma_c_native(duk_context * ctx) {
     int n = duk_get_top(ctx);
     int i;
-    gensyn_t * inst = gensyn_table_find(ecmaToInstance, ctx);
+    // the context is the heap's user data
+    duk_memory_functions funcs;
+    duk_get_memory_functions(ctx, &funcs);
+    gensyn_t * inst = funcs.udata;
     const gensyn_string_t * args[n];
     
     for(i = 0; i < n; ++i) {
@@ -658,6 +1338,23 @@ static void gensyn_command__gate_add(
 }
 
 
+static void gensyn_command__gate_remove(
+    gensyn_t *          ctx, 
+    gensyn_string_t **  args, 
+    int                 argc, 
+    gensyn_string_t *   output
+) {
+    if (argc == 0) {
+        gensyn_string_concat_printf(output, "No gate name given.");
+        return;
+    }
+    if (!gensyn_get_named_gate(ctx, args[0])) {
+        gensyn_string_concat_printf(output, "No gate with the given name");
+        return;
+    }
+    gensyn_destroy_named_gate(ctx, args[0]);
+}
+
 static const char * gensyn_gate_type_to_cstr(const gensyn_gate_t * g) {
     switch(gensyn_gate_get_type(g)) {
       case GENSYN_GATE__TYPE__INPUT:     return "InputGate";
@@ -741,7 +1438,7 @@ static void gensyn_command__gate_summary(
     names = gensyn_gate_get_param_names(g);
     for(i = 0; i < gensyn_array_get_size(names); ++i) {
         const gensyn_string_t * name = gensyn_array_at(names, gensyn_string_t *, i);
-        float val = gensyn_gate_get_parameter(g, name);
+        float val = gensyn_gate_get_parameter_by_handle(g, i);
         gensyn_string_concat_printf(output, "   - %s : %f\n", gensyn_string_get_c_str(name), val);
     }
 
@@ -856,6 +1553,37 @@ static void gensyn_command__gate_set_param(
     );
 }
 
+static void gensyn_command__gate_set_template(
+    gensyn_t *          ctx,
+    gensyn_string_t **  args,
+    int                 argc,
+    gensyn_string_t *   output
+) {
+    if (argc < 3) {
+        gensyn_string_concat_printf(output, "Insufficient arguments");
+        return;
+    }
+
+    gensyn_gate_t * voices         = gensyn_get_named_gate(ctx, args[0]);
+    gensyn_gate_t * templateOutput = gensyn_get_named_gate(ctx, args[1]);
+    int count = atoi(gensyn_string_get_c_str(args[2]));
+
+    if (!voices || !templateOutput) {
+        gensyn_string_concat_printf(output, "Unrecognized gate name.");
+        return;
+    }
+    if (!gensyn_string_test_eq(gensyn_gate_get_class(voices), GENSYN_STR_CAST("Voices"))) {
+        gensyn_string_concat_printf(output, "%s is not a Voices gate.", gensyn_string_get_c_str(args[0]));
+        return;
+    }
+    if (count < 1) {
+        gensyn_string_concat_printf(output, "At least one voice is needed.");
+        return;
+    }
+
+    voices__set(voices, gensyn_voices_create(ctx, templateOutput, count));
+}
+
 
 
 
@@ -867,13 +1595,6 @@ static void gensyn_input_loop_thread__process_event(
     gensyn_t * g,
     const gensyn_system__input_event_t * event 
 ) {
-    
-    printf("EVENT: %d %d %d %d\n",
-        event->deviceID,
-        event->input,
-        event->inputData1,
-        event->inputData2
-    );
     uint32_t i;
     for(i = 0; i < gensyn_array_get_size(g->inputGates); ++i) {
         gensyn_gate_send_event(
@@ -881,12 +1602,15 @@ static void gensyn_input_loop_thread__process_event(
             event
         );
     }
+    
+    // if the waveform is not being generated, the ring 
+    // fills up and later events are dropped.
+    gensyn_ring_push_p(g->events, event);
 }
 
 
 static void * gensyn_input_loop_thread__main(void * gSrc) {
     #define MAX_EVENTS_PER_ITER 128
-    #define ITER_WAIT_TIME_MS   1
     gensyn_system__input_event_t events[MAX_EVENTS_PER_ITER];
     
 
@@ -898,10 +1622,24 @@ static void * gensyn_input_loop_thread__main(void * gSrc) {
     
     time_t timeNow = 0;
     uint32_t count;
-    for(;;) {
-        // remove all old gates
-        while (gensyn_ring_has_pending(g->commandRemove)) {
-            gensyn_gate_t * gate = gensyn_ring_pop(g->commandRemove, gensyn_gate_t *);
+    while(!atomic_load(&g->inputQuit)) {
+        gensyn_gate_t * gate;
+
+        // get all new gates first, since a gate 
+        // may be added and removed in one go.
+        while (gensyn_ring_pop(g->commandAdd, gate)) {
+            gensyn_array_push(g->inputGates, gate);
+        }
+
+        // remove all old gates. Each one is freed once 
+        // this has counted it, so it must not be used after.
+        while (gensyn_ring_pop(g->commandRemove, gate)) {
+            // its add was sent first, but may have 
+            // arrived after the adds were taken above.
+            gensyn_gate_t * added;
+            while (gensyn_ring_pop(g->commandAdd, added)) {
+                gensyn_array_push(g->inputGates, added);
+            }
             uint32_t i;
             for(i = 0; i < gensyn_array_get_size(g->inputGates); ++i) {
                 if (gate == gensyn_array_at(g->inputGates, gensyn_gate_t *, i)) {
@@ -909,43 +1647,46 @@ static void * gensyn_input_loop_thread__main(void * gSrc) {
                     break;
                 }
             }
-        }
-        
-        // get all new gates 
-        while (gensyn_ring_has_pending(g->commandAdd)) {
-            gensyn_gate_t * gate = gensyn_ring_pop(g->commandAdd, gensyn_gate_t *);
-            gensyn_array_push(g->inputGates, gate);
+            atomic_fetch_add(&g->inputRemovesDone, 1);
         }
 
         
         
 
         // priodically check the device state
-        if (timeNow != time(NULL)) {
+        if (g->options.probeDevices && timeNow != time(NULL)) {
             gensyn_system_input_query_devices(sys);
             timeNow = time(NULL);
         }
         
         gensyn_system_input_update(sys);
 
-        while(gensyn_system_input_get_events( 
-            sys,
-            events,
-            MAX_EVENTS_PER_ITER,
-            &count)) {
+        int more;
+        do {
+            more = gensyn_system_input_get_events( 
+                sys,
+                events,
+                MAX_EVENTS_PER_ITER,
+                &count
+            );
             
             uint32_t i;
             for(i = 0; i < count; ++i) {
                 gensyn_input_loop_thread__process_event(g, events+i);
             }            
-        }
+        } while(more);
         
-        gensyn_system_usleep(1000);
+        // sleep until there is input. Without probing, only input, 
+        // a new gate or gensyn_destroy wakes the loop.
+        gensyn_system_input_wait(sys, g->options.probeDevices ? 1000 : -1);
     }
+    atomic_store(&g->inputRunning, 0);
+    return NULL;
 }
 
 
 void gensyn_start_input_loop(gensyn_t * t) {
+    atomic_store(&t->inputRunning, 1);
     gensyn_system_thread_create(t->sys, gensyn_input_loop_thread__main, t);
 }
 
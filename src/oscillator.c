@@ -0,0 +1,199 @@
+#include <gensyn/oscillator.h>
+
+#include <math.h>
+#include <string.h>
+#include <threads.h>
+
+
+// each table is one full cycle
+#define TABLE_BITS 11
+#define TABLE_SIZE (1 << TABLE_BITS)
+
+// bits of the phase below the table index
+#define FRAC_BITS (32 - TABLE_BITS)
+#define FRAC_MASK ((1u << FRAC_BITS) - 1)
+
+// band-limited shapes have one table per octave. Level 0 holds
+// all the harmonics a table can, each level after holds half as many,
+// down to the plain sine at the last level.
+#define LEVEL_COUNT TABLE_BITS
+
+#define SHAPE_COUNT 4
+
+
+
+// each table has one extra sample (a copy of the first) so
+// that interpolation never has to wrap.
+static float sineTable[TABLE_SIZE+1];
+static float shapeTables[SHAPE_COUNT][LEVEL_COUNT][TABLE_SIZE+1];
+
+static once_flag sineOnce  = ONCE_FLAG_INIT;
+static once_flag shapeOnce = ONCE_FLAG_INIT;
+
+
+
+
+static void gensyn_oscillator__build_sine() {
+    uint32_t i;
+    for(i = 0; i < TABLE_SIZE; ++i) {
+        sineTable[i] = sin(2 * M_PI * (i / (double)TABLE_SIZE));
+    }
+    sineTable[TABLE_SIZE] = sineTable[0];
+}
+
+
+// Returns the amplitude of harmonic h for the shape.
+static double gensyn_oscillator__harmonic(gensyn_oscillator__shape_e shape, uint32_t h) {
+    switch(shape) {
+      case GENSYN_OSCILLATOR__SHAPE__SAW:
+        return (h % 2 ? 2 : -2) / (M_PI * h);
+
+      case GENSYN_OSCILLATOR__SHAPE__SQUARE:
+        return h % 2 ? 4 / (M_PI * h) : 0;
+
+      case GENSYN_OSCILLATOR__SHAPE__TRIANGLE:
+        if (h % 2 == 0) return 0;
+        return (h % 4 == 1 ? 8 : -8) / (M_PI * M_PI * h * h);
+
+      default:
+        return h == 1;
+    }
+}
+
+
+// Builds the tables by summing harmonics from the sine table, starting
+// from the highest level (fewest harmonics) and adding more for each
+// level below it. Each level is scaled to a peak of 1.
+static void gensyn_oscillator__build_shapes() {
+    static double sum[TABLE_SIZE];
+    int shape, level;
+    uint32_t i, h;
+    call_once(&sineOnce, gensyn_oscillator__build_sine);
+
+    for(shape = GENSYN_OSCILLATOR__SHAPE__SAW; shape < SHAPE_COUNT; ++shape) {
+        memset(sum, 0, sizeof(sum));
+        h = 1;
+        for(level = LEVEL_COUNT-1; level >= 0; --level) {
+            uint32_t harmonics = (TABLE_SIZE/2) >> level;
+            for(; h <= harmonics; ++h) {
+                double amp = gensyn_oscillator__harmonic(shape, h);
+                if (amp == 0) continue;
+                for(i = 0; i < TABLE_SIZE; ++i) {
+                    sum[i] += amp * sineTable[(h*i) % TABLE_SIZE];
+                }
+            }
+
+            double peak = 0;
+            for(i = 0; i < TABLE_SIZE; ++i) {
+                if (fabs(sum[i]) > peak) peak = fabs(sum[i]);
+            }
+            float * table = shapeTables[shape][level];
+            for(i = 0; i < TABLE_SIZE; ++i) {
+                table[i] = peak > 0 ? sum[i] / peak : 0;
+            }
+            table[TABLE_SIZE] = table[0];
+        }
+    }
+}
+
+
+// Returns the table to use at the given phase increment.
+// The highest harmonic in the table must stay under half a cycle per sample.
+static const float * gensyn_oscillator__table(gensyn_oscillator__shape_e shape, uint32_t inc) {
+    if (shape == GENSYN_OSCILLATOR__SHAPE__SINE) return sineTable;
+    if (inc > 0x80000000u) inc = -inc;
+
+    int level = 0;
+    while(level < LEVEL_COUNT-1 && (uint64_t)((TABLE_SIZE/2) >> level) * inc > 0x80000000u) {
+        level++;
+    }
+    return shapeTables[shape][level];
+}
+
+
+static inline float gensyn_oscillator__lookup(const float * table, uint32_t phase) {
+    uint32_t index = phase >> FRAC_BITS;
+    float frac = (phase & FRAC_MASK) * (1.f / (1u << FRAC_BITS));
+    return table[index] + (table[index+1] - table[index])*frac;
+}
+
+
+static inline uint32_t gensyn_oscillator__increment(float hz, float scale) {
+    return (uint32_t)(int64_t)(hz * scale);
+}
+
+
+
+
+
+void gensyn_oscillator_init(gensyn_oscillator_t * osc, gensyn_oscillator__shape_e shape) {
+    call_once(&sineOnce, gensyn_oscillator__build_sine);
+    if (shape != GENSYN_OSCILLATOR__SHAPE__SINE) {
+        call_once(&shapeOnce, gensyn_oscillator__build_shapes);
+    }
+    osc->phase = 0;
+    osc->shape = shape;
+}
+
+
+void gensyn_oscillator_run(
+    gensyn_oscillator_t * osc,
+    gensyn_sample_t * samplesOut,
+    uint32_t sampleCount,
+    float hz,
+    float sampleRate
+) {
+    uint32_t inc = gensyn_oscillator__increment(hz, 4294967296.f / sampleRate);
+    const float * table = gensyn_oscillator__table(osc->shape, inc);
+    uint32_t phase = osc->phase;
+    uint32_t i;
+    for(i = 0; i < sampleCount; ++i) {
+        samplesOut[i] = gensyn_oscillator__lookup(table, phase);
+        phase += inc;
+    }
+    osc->phase = phase;
+}
+
+
+void gensyn_oscillator_run_modulated(
+    gensyn_oscillator_t * osc,
+    gensyn_sample_t * samplesOut,
+    const gensyn_sample_t * hz,
+    const gensyn_sample_t * phaseOffset,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    if (!sampleCount) return;
+    float scale = 4294967296.f / sampleRate;
+    uint32_t phase = osc->phase;
+    uint32_t i;
+
+    // band-limited shapes pick the table for the highest
+    // frequency in the block so that none of it aliases.
+    const float * table = sineTable;
+    if (osc->shape != GENSYN_OSCILLATOR__SHAPE__SINE) {
+        float highest = 0;
+        for(i = 0; i < sampleCount; ++i) {
+            if (fabsf(hz[i]) > highest) highest = fabsf(hz[i]);
+        }
+        table = gensyn_oscillator__table(osc->shape, gensyn_oscillator__increment(highest, scale));
+    }
+
+    if (phaseOffset) {
+        for(i = 0; i < sampleCount; ++i) {
+            uint32_t inc = gensyn_oscillator__increment(hz[i], scale);
+            samplesOut[i] = gensyn_oscillator__lookup(
+                table,
+                phase + (uint32_t)(int64_t)(phaseOffset[i] * 4294967296.f)
+            );
+            phase += inc;
+        }
+    } else {
+        for(i = 0; i < sampleCount; ++i) {
+            uint32_t inc = gensyn_oscillator__increment(hz[i], scale);
+            samplesOut[i] = gensyn_oscillator__lookup(table, phase);
+            phase += inc;
+        }
+    }
+    osc->phase = phase;
+}
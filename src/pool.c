@@ -0,0 +1,284 @@
+#include <gensyn/pool.h>
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+
+#define POOL_CACHE_LINE 64
+
+// how many times a thread checks for its wake up
+// before sleeping. Levels of the same block follow
+// each other closely, so most wake ups need no call 
+// into the kernel.
+#define POOL_SPIN 2000
+
+
+// The range of tasks owned by one thread in the pool.
+// The owner takes from the front while other threads steal
+// from the back. Both ends are packed into one word so that
+// claiming a task is a single compare-and-swap:
+// the low 32 bits are the next task, the high 32 bits are the end.
+typedef struct {
+    _Atomic uint64_t range;
+    uint8_t padding[POOL_CACHE_LINE - sizeof(uint64_t)];
+} gensyn_pool__queue_t;
+
+
+typedef struct {
+    gensyn_pool_t * pool;
+    uint32_t index;
+} gensyn_pool__worker_t;
+
+
+struct gensyn_pool_t {
+    uint32_t workerCount;
+    thrd_t * threads;
+    gensyn_pool__worker_t * workers;
+
+    // one per worker, plus one for the thread calling run.
+    gensyn_pool__queue_t * queues;
+
+    // the current batch.
+    void (*task)(void *, uint32_t);
+    void * userData;
+    _Atomic uint32_t remaining;
+
+    // bumped to start a batch or to quit. Idle workers sleep on it.
+    _Atomic uint32_t generation;
+    atomic_int quit;
+
+    // workers that may be asleep on generation, so that
+    // a batch only wakes them through the kernel when needed.
+    atomic_uint sleepers;
+
+    // set while the calling thread sleeps on remaining.
+    atomic_int waiting;
+
+    // the scheduling of the thread calling run, which each worker
+    // takes on itself whenever policyChanges moves on. Workers that 
+    // were left behind under SCHED_FIFO would never get to run.
+    pthread_t caller;
+    int hasCaller;
+    int policy;
+    struct sched_param param;
+    _Atomic uint32_t policyChanges;
+};
+
+
+
+#define POOL_PACK(__HEAD__, __TAIL__) (((uint64_t)(__TAIL__) << 32) | (uint64_t)(__HEAD__))
+#define POOL_HEAD(__R__) ((uint32_t)((__R__) & 0xffffffff))
+#define POOL_TAIL(__R__) ((uint32_t)((__R__) >> 32))
+
+
+// Sleeps until woken, unless the word no longer holds value.
+static void gensyn_pool__sleep(_Atomic uint32_t * word, uint32_t value) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+// Wakes up to count threads sleeping on the word.
+static void gensyn_pool__wake(_Atomic uint32_t * word, int count) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+
+// Claims the next task from the front of the queue.
+// Returns 0 if the queue is empty.
+static int gensyn_pool__take_front(gensyn_pool__queue_t * q, uint32_t * index) {
+    uint64_t r = atomic_load_explicit(&q->range, memory_order_acquire);
+    while(POOL_HEAD(r) < POOL_TAIL(r)) {
+        if (atomic_compare_exchange_weak_explicit(
+            &q->range, &r, POOL_PACK(POOL_HEAD(r)+1, POOL_TAIL(r)),
+            memory_order_acq_rel, memory_order_acquire
+        )) {
+            *index = POOL_HEAD(r);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Claims the last task from the back of the queue.
+// Returns 0 if the queue is empty.
+static int gensyn_pool__steal_back(gensyn_pool__queue_t * q, uint32_t * index) {
+    uint64_t r = atomic_load_explicit(&q->range, memory_order_acquire);
+    while(POOL_HEAD(r) < POOL_TAIL(r)) {
+        if (atomic_compare_exchange_weak_explicit(
+            &q->range, &r, POOL_PACK(POOL_HEAD(r), POOL_TAIL(r)-1),
+            memory_order_acq_rel, memory_order_acquire
+        )) {
+            *index = POOL_TAIL(r)-1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Works through the thread's own queue, then steals
+// from the others until none have any tasks left.
+static void gensyn_pool__work(gensyn_pool_t * p, uint32_t self) {
+    uint32_t index;
+    uint32_t n, i;
+    uint32_t queueCount = p->workerCount+1;
+    uint32_t done = 0;
+    while(gensyn_pool__take_front(p->queues+self, &index)) {
+        p->task(p->userData, index);
+        done++;
+    }
+
+    for(n = 1; n < queueCount; ++n) {
+        i = (self + n) % queueCount;
+        while(gensyn_pool__steal_back(p->queues+i, &index)) {
+            p->task(p->userData, index);
+            done++;
+        }
+    }
+
+    // the last one done wakes the calling thread if it went to sleep.
+    if (done && atomic_fetch_sub(&p->remaining, done) == done && atomic_load(&p->waiting)) {
+        gensyn_pool__wake(&p->remaining, 1);
+    }
+}
+
+
+static int gensyn_pool__worker_main(void * src) {
+    gensyn_pool__worker_t * w = src;
+    gensyn_pool_t * p = w->pool;
+    uint32_t seen = 0;
+    uint32_t policySeen = 0;
+    uint32_t generation, spins;
+    for(;;) {
+        for(spins = 0; (generation = atomic_load(&p->generation)) == seen; ++spins) {
+            if (spins < POOL_SPIN) continue;
+            atomic_fetch_add(&p->sleepers, 1);
+            gensyn_pool__sleep(&p->generation, seen);
+            atomic_fetch_sub(&p->sleepers, 1);
+        }
+        seen = generation;
+        if (atomic_load(&p->quit)) {
+            return 0;
+        }
+
+        if (atomic_load(&p->policyChanges) != policySeen) {
+            policySeen = atomic_load(&p->policyChanges);
+            pthread_setschedparam(pthread_self(), p->policy, &p->param);
+        }
+        gensyn_pool__work(p, w->index);
+    }
+}
+
+
+
+
+gensyn_pool_t * gensyn_pool_create(uint32_t workerCount) {
+    gensyn_pool_t * p = calloc(1, sizeof(gensyn_pool_t));
+    p->workerCount = workerCount;
+    p->queues = aligned_alloc(POOL_CACHE_LINE, sizeof(gensyn_pool__queue_t)*(workerCount+1));
+    uint32_t i;
+    for(i = 0; i < workerCount+1; ++i) {
+        atomic_init(&p->queues[i].range, 0);
+    }
+    atomic_init(&p->remaining, 0);
+    atomic_init(&p->generation, 0);
+    atomic_init(&p->quit, 0);
+    atomic_init(&p->sleepers, 0);
+    atomic_init(&p->waiting, 0);
+    atomic_init(&p->policyChanges, 0);
+
+    p->threads = calloc(workerCount+1, sizeof(thrd_t));
+    p->workers = calloc(workerCount+1, sizeof(gensyn_pool__worker_t));
+    for(i = 0; i < workerCount; ++i) {
+        p->workers[i].pool = p;
+        p->workers[i].index = i;
+        thrd_create(p->threads+i, gensyn_pool__worker_main, p->workers+i);
+    }
+    return p;
+}
+
+
+void gensyn_pool_destroy(gensyn_pool_t * p) {
+    uint32_t i;
+    atomic_store(&p->quit, 1);
+    atomic_fetch_add(&p->generation, 1);
+    gensyn_pool__wake(&p->generation, INT_MAX);
+
+    for(i = 0; i < p->workerCount; ++i) {
+        thrd_join(p->threads[i], NULL);
+    }
+    free(p->threads);
+    free(p->workers);
+    free(p->queues);
+    free(p);
+}
+
+uint32_t gensyn_pool_get_worker_count(const gensyn_pool_t * p) {
+    return p->workerCount;
+}
+
+
+void gensyn_pool_run(
+    gensyn_pool_t * p,
+    uint32_t count,
+    void (*task)(void * userData, uint32_t index),
+    void * userData
+) {
+    uint32_t i;
+    if (!count) return;
+
+    // nothing to split.
+    if (!p->workerCount || count == 1) {
+        for(i = 0; i < count; ++i) {
+            task(userData, i);
+        }
+        return;
+    }
+
+    // only looked up when the calling thread changes, 
+    // which is once the audio thread takes over.
+    if (!p->hasCaller || !pthread_equal(p->caller, pthread_self())) {
+        p->caller = pthread_self();
+        p->hasCaller = 1;
+        pthread_getschedparam(p->caller, &p->policy, &p->param);
+        atomic_fetch_add(&p->policyChanges, 1);
+    }
+
+    uint32_t queueCount = p->workerCount+1;
+    p->task = task;
+    p->userData = userData;
+    atomic_store_explicit(&p->remaining, count, memory_order_relaxed);
+    for(i = 0; i < queueCount; ++i) {
+        atomic_store_explicit(
+            &p->queues[i].range,
+            POOL_PACK(
+                (uint64_t)count* i    / queueCount,
+                (uint64_t)count*(i+1) / queueCount
+            ),
+            memory_order_release
+        );
+    }
+
+    atomic_fetch_add(&p->generation, 1);
+    if (atomic_load(&p->sleepers)) {
+        gensyn_pool__wake(&p->generation, INT_MAX);
+    }
+
+    // the calling thread always takes the last queue.
+    gensyn_pool__work(p, p->workerCount);
+    uint32_t remaining, spins;
+    for(spins = 0; (remaining = atomic_load(&p->remaining)); ++spins) {
+        if (spins < POOL_SPIN) continue;
+        atomic_store(&p->waiting, 1);
+        if ((remaining = atomic_load(&p->remaining))) {
+            gensyn_pool__sleep(&p->remaining, remaining);
+        }
+        atomic_store(&p->waiting, 0);
+    }
+}
@@ -0,0 +1,282 @@
+#include <gensyn/render.h>
+#include <gensyn/pool.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// converted samples are collected into chunks of this many
+// bytes and written with one call each.
+#define RENDER_CHUNK_SIZE (1 << 20)
+
+#define WAVE_FORMAT_PCM        1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+
+
+
+
+static double gensyn_render__now() {
+    struct timespec t;
+    timespec_get(&t, TIME_UTC);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+
+static uint32_t gensyn_render__bytes_per_sample(gensyn_render__format_e format) {
+    switch(format) {
+      case GENSYN_RENDER__FORMAT__PCM16: return 2;
+      case GENSYN_RENDER__FORMAT__PCM24: return 3;
+      default:                           return 4;
+    }
+}
+
+
+static uint8_t * gensyn_render__put_u16(uint8_t * out, uint16_t v) {
+    out[0] = v;
+    out[1] = v >> 8;
+    return out+2;
+}
+
+static uint8_t * gensyn_render__put_u32(uint8_t * out, uint32_t v) {
+    out[0] = v;
+    out[1] = v >> 8;
+    out[2] = v >> 16;
+    out[3] = v >> 24;
+    return out+4;
+}
+
+static uint8_t * gensyn_render__put_tag(uint8_t * out, const char * tag) {
+    memcpy(out, tag, 4);
+    return out+4;
+}
+
+
+// Writes the RIFF header for a file of sampleCount frames of the 
+// given channels. Float files get the extended fmt chunk and the 
+// fact chunk that the format requires.
+// Returns the number of bytes written to out.
+static uint32_t gensyn_render__header(
+    uint8_t * out,
+    gensyn_render__format_e format,
+    uint32_t channels,
+    uint32_t sampleRate,
+    uint32_t sampleCount
+) {
+    uint32_t bytesPerSample = gensyn_render__bytes_per_sample(format);
+    uint32_t frameSize = bytesPerSample * channels;
+    uint32_t dataSize = sampleCount * frameSize;
+    int isFloat = format == GENSYN_RENDER__FORMAT__FLOAT32;
+    uint32_t fmtSize = isFloat ? 18 : 16;
+    uint32_t factSize = isFloat ? 12 : 0;
+
+    uint8_t * iter = out;
+    iter = gensyn_render__put_tag(iter, "RIFF");
+    iter = gensyn_render__put_u32(iter, 4 + (8 + fmtSize) + factSize + (8 + dataSize));
+    iter = gensyn_render__put_tag(iter, "WAVE");
+
+    iter = gensyn_render__put_tag(iter, "fmt ");
+    iter = gensyn_render__put_u32(iter, fmtSize);
+    iter = gensyn_render__put_u16(iter, isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    iter = gensyn_render__put_u16(iter, channels);
+    iter = gensyn_render__put_u32(iter, sampleRate);
+    iter = gensyn_render__put_u32(iter, sampleRate * frameSize);
+    iter = gensyn_render__put_u16(iter, frameSize);
+    iter = gensyn_render__put_u16(iter, bytesPerSample * 8);
+    if (isFloat) {
+        iter = gensyn_render__put_u16(iter, 0); // no extension
+
+        iter = gensyn_render__put_tag(iter, "fact");
+        iter = gensyn_render__put_u32(iter, 4);
+        iter = gensyn_render__put_u32(iter, sampleCount);
+    }
+
+    iter = gensyn_render__put_tag(iter, "data");
+    iter = gensyn_render__put_u32(iter, dataSize);
+    return iter - out;
+}
+
+
+static float gensyn_render__clip(float v) {
+    if (v > gensyn_sample_max) return gensyn_sample_max;
+    if (v < gensyn_sample_min) return gensyn_sample_min;
+    return v;
+}
+
+
+// Converts the separate samples of each channel to interleaved 
+// samples of the file format. Returns the end of the written bytes.
+static uint8_t * gensyn_render__convert(
+    uint8_t * out,
+    gensyn_sample_t ** channels,
+    uint32_t channelCount,
+    uint32_t count,
+    gensyn_render__format_e format
+) {
+    uint32_t i, c;
+    switch(format) {
+      case GENSYN_RENDER__FORMAT__PCM16:
+        for(i = 0; i < count; ++i) {
+            for(c = 0; c < channelCount; ++c) {
+                int32_t v = lrintf(gensyn_render__clip(channels[c][i]) * 32767.f);
+                out = gensyn_render__put_u16(out, (uint16_t)v);
+            }
+        }
+        break;
+
+      case GENSYN_RENDER__FORMAT__PCM24:
+        for(i = 0; i < count; ++i) {
+            for(c = 0; c < channelCount; ++c) {
+                int32_t v = lrintf(gensyn_render__clip(channels[c][i]) * 8388607.f);
+                out[0] = v;
+                out[1] = v >> 8;
+                out[2] = v >> 16;
+                out += 3;
+            }
+        }
+        break;
+
+      default:
+        for(i = 0; i < count; ++i) {
+            for(c = 0; c < channelCount; ++c) {
+                uint32_t v;
+                memcpy(&v, channels[c]+i, sizeof(uint32_t));
+                out = gensyn_render__put_u32(out, v);
+            }
+        }
+        break;
+    }
+    return out;
+}
+
+
+
+
+
+void gensyn_render_options_init(gensyn_render_options_t * options) {
+    options->sampleRate = 44100;
+    options->blockSize = 256;
+    options->duration = 10;
+    options->format = GENSYN_RENDER__FORMAT__FLOAT32;
+}
+
+
+int gensyn_render_to_file(
+    gensyn_t * g,
+    const char * path,
+    const gensyn_render_options_t * optionsSrc,
+    gensyn_render_stats_t * stats
+) {
+    gensyn_render_options_t options;
+    if (optionsSrc) {
+        options = *optionsSrc;
+    } else {
+        gensyn_render_options_init(&options);
+    }
+    if (options.sampleRate < 1 || !options.blockSize || options.duration < 0) return 0;
+
+    // the sizes in a WAV header are 32 bits.
+    uint32_t channelCount = gensyn_get_channel_count(g);
+    uint32_t bytesPerFrame = gensyn_render__bytes_per_sample(options.format) * channelCount;
+    double total = floor(options.duration * options.sampleRate + .5);
+    if (total * bytesPerFrame > 0xffffffffu - 64) return 0;
+    uint32_t sampleCount = total;
+
+    FILE * f = fopen(path, "wb");
+    if (!f) return 0;
+    setvbuf(f, NULL, _IONBF, 0);
+
+    uint32_t chunkFrames = RENDER_CHUNK_SIZE / bytesPerFrame;
+    if (chunkFrames < options.blockSize) chunkFrames = options.blockSize;
+    uint8_t * chunk = malloc(chunkFrames * bytesPerFrame);
+    gensyn_sample_t * block = malloc((size_t)options.blockSize * channelCount * sizeof(gensyn_sample_t));
+    gensyn_sample_t * channels[channelCount];
+    uint32_t i;
+    for(i = 0; i < channelCount; ++i) {
+        channels[i] = block + (size_t)i*options.blockSize;
+    }
+
+    double start = gensyn_render__now();
+    int ok = 1;
+
+    uint8_t header[64];
+    uint32_t headerSize = gensyn_render__header(header, options.format, channelCount, (uint32_t)options.sampleRate, sampleCount);
+    ok = fwrite(header, 1, headerSize, f) == headerSize;
+
+
+    uint8_t * iter = chunk;
+    uint32_t done = 0;
+    while(ok && done < sampleCount) {
+        // the last block may be short
+        uint32_t count = sampleCount - done;
+        if (count > options.blockSize) count = options.blockSize;
+
+        if ((iter - chunk) + count*bytesPerFrame > chunkFrames*bytesPerFrame) {
+            ok = fwrite(chunk, 1, iter - chunk, f) == (size_t)(iter - chunk);
+            iter = chunk;
+        }
+
+        gensyn_generate_waveform_planar(g, channels, count, options.sampleRate);
+        iter = gensyn_render__convert(iter, channels, channelCount, count, options.format);
+        done += count;
+    }
+    if (ok && iter != chunk) {
+        ok = fwrite(chunk, 1, iter - chunk, f) == (size_t)(iter - chunk);
+    }
+    if (fclose(f)) ok = 0;
+
+    free(block);
+    free(chunk);
+
+    if (stats) {
+        stats->sampleCount = done;
+        stats->seconds = gensyn_render__now() - start;
+        stats->speed = stats->seconds > 0 ? (done / options.sampleRate) / stats->seconds : 0;
+    }
+    return ok;
+}
+
+
+
+
+typedef struct {
+    gensyn_render_job_t * jobs;
+    const gensyn_render_options_t * options;
+} gensyn_render__batch_t;
+
+
+static void gensyn_render__batch_job(void * data, uint32_t index) {
+    gensyn_render__batch_t * batch = data;
+    gensyn_render_job_t * job = batch->jobs+index;
+
+    gensyn_t * g = gensyn_create_headless();
+    gensyn_send_command(g, GENSYN_STR_CAST(job->script));
+    job->result = gensyn_render_to_file(g, job->path, batch->options, &job->stats);
+    gensyn_destroy(g);
+}
+
+
+uint32_t gensyn_render_batch(
+    gensyn_render_job_t * jobs,
+    uint32_t jobCount,
+    const gensyn_render_options_t * options,
+    uint32_t threadCount
+) {
+    gensyn_render__batch_t batch;
+    batch.jobs = jobs;
+    batch.options = options;
+
+    // the calling thread is one of the threads
+    gensyn_pool_t * pool = gensyn_pool_create(threadCount ? threadCount-1 : 0);
+    gensyn_pool_run(pool, jobCount, gensyn_render__batch_job, &batch);
+    gensyn_pool_destroy(pool);
+
+    uint32_t i;
+    uint32_t written = 0;
+    for(i = 0; i < jobCount; ++i) {
+        written += jobs[i].result;
+    }
+    return written;
+}
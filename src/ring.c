@@ -2,28 +2,58 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #ifdef GENSYNDC_DEBUG
 #include <assert.h>
 #endif
 
 
+#define RING_CACHE_LINE 64
+
+
+// read and write count up forever and wrap around at 2^32.
+// The slot for an index is index & mask, so the capacity
+// is always a power of two, and write - read is always
+// the number of pending elements, even after wrapping.
+//
+// Each side's index lives on its own cache line, along with
+// its last view of the other side's index, so that the two
+// threads only touch shared lines when they need to.
 struct gensyn_ring_t {
-    uint32_t read;
-    uint32_t write;
-    
+    // owned by the writer
+    _Atomic uint32_t write;
+    uint32_t readCache;
+    uint8_t padding0[RING_CACHE_LINE - 2*sizeof(uint32_t)];
+
+    // owned by the reader
+    _Atomic uint32_t read;
+    uint32_t writeCache;
+    uint8_t padding1[RING_CACHE_LINE - 2*sizeof(uint32_t)];
+
+    // constant after creation
     uint8_t * buffer;
     uint32_t sizeofType;
-    uint32_t count;
+    uint32_t capacity;
+    uint32_t mask;
 };
 
 
 
 gensyn_ring_t * gensyn_ring_create(uint32_t sizeofType, uint32_t count) {
-    gensyn_ring_t * ring = calloc(1, sizeof(gensyn_ring_t));
+    uint32_t capacity = 1;
+    while(capacity < count) capacity <<= 1;
+
+    size_t size = (sizeof(gensyn_ring_t) + RING_CACHE_LINE-1) & ~(size_t)(RING_CACHE_LINE-1);
+    gensyn_ring_t * ring = aligned_alloc(RING_CACHE_LINE, size);
+    memset(ring, 0, sizeof(gensyn_ring_t));
+    atomic_init(&ring->write, 0);
+    atomic_init(&ring->read, 0);
+
     ring->sizeofType = sizeofType;
-    ring->buffer = calloc(sizeofType, count);
-    ring->count = count;
+    ring->capacity = capacity;
+    ring->mask = capacity-1;
+    ring->buffer = calloc(sizeofType, capacity);
     return ring;
 }
 
@@ -34,30 +64,110 @@ void gensyn_ring_destroy(gensyn_ring_t * r) {
 }
 
 
+uint32_t gensyn_ring_get_capacity(const gensyn_ring_t * r) {
+    return r->capacity;
+}
 
 int gensyn_ring_has_pending(const gensyn_ring_t * r) {
-    return r->read != r->write;
+    return gensyn_ring_get_pending_count(r) != 0;
+}
+
+uint32_t gensyn_ring_get_pending_count(const gensyn_ring_t * r) {
+    uint32_t read  = atomic_load_explicit(&((gensyn_ring_t *)r)->read,  memory_order_acquire);
+    uint32_t write = atomic_load_explicit(&((gensyn_ring_t *)r)->write, memory_order_acquire);
+    return write - read;
+}
+
+
+
+
+
+void * gensyn_ring_reserve(gensyn_ring_t * r, uint32_t count, uint32_t * available) {
+    uint32_t write = atomic_load_explicit(&r->write, memory_order_relaxed);
+    uint32_t space = r->capacity - (write - r->readCache);
+
+    // only look at the reader's index when the last view of it is not enough
+    if (space < count) {
+        r->readCache = atomic_load_explicit(&r->read, memory_order_acquire);
+        space = r->capacity - (write - r->readCache);
+    }
+
+    uint32_t slot = write & r->mask;
+    if (space > r->capacity - slot) space = r->capacity - slot;
+    if (space > count) space = count;
+    *available = space;
+    return space ? r->buffer + slot*r->sizeofType : NULL;
+}
+
+void gensyn_ring_commit(gensyn_ring_t * r, uint32_t count) {
+    #ifdef GENSYNDC_DEBUG
+        assert(count <= r->capacity - (atomic_load(&r->write) - atomic_load(&r->read)));
+    #endif
+    uint32_t write = atomic_load_explicit(&r->write, memory_order_relaxed);
+    atomic_store_explicit(&r->write, write + count, memory_order_release);
 }
 
+
 int gensyn_ring_push_p(gensyn_ring_t * r, const void * p) {
-    uint32_t writeReal = r->write;
-    if (writeReal == (r->read-1)%r->count) return 0;
-    if (writeReal == (r->read-2)%r->count) return 0; // read-ahead buffer
+    return gensyn_ring_push_n(r, p, 1) == 1;
+}
 
-    memcpy(
-        r->buffer + writeReal * (r->sizeofType*writeReal),
-        p,
-        r->sizeofType
-    );
-    r->write = (writeReal+1)%r->count;
-    return 1;
+uint32_t gensyn_ring_push_n(gensyn_ring_t * r, const void * p, uint32_t count) {
+    const uint8_t * src = p;
+    uint32_t pushed = 0;
+    uint32_t available;
+    void * dest;
+
+    // at most twice: once up to the end of the buffer, once from the start
+    while(pushed < count && (dest = gensyn_ring_reserve(r, count - pushed, &available))) {
+        memcpy(dest, src + pushed*r->sizeofType, available*r->sizeofType);
+        gensyn_ring_commit(r, available);
+        pushed += available;
+    }
+    return pushed;
 }
 
-const void * gensyn_ring_pop_p(gensyn_ring_t * r) {
-    const void * out = r->buffer+r->read*r->sizeofType;
-    r->read++;
-    return out;
+
+
+
+
+const void * gensyn_ring_peek(gensyn_ring_t * r, uint32_t * available) {
+    uint32_t read = atomic_load_explicit(&r->read, memory_order_relaxed);
+    if (r->writeCache == read) {
+        r->writeCache = atomic_load_explicit(&r->write, memory_order_acquire);
+    }
+
+    uint32_t pending = r->writeCache - read;
+    uint32_t slot = read & r->mask;
+    if (pending > r->capacity - slot) pending = r->capacity - slot;
+    *available = pending;
+    return pending ? r->buffer + slot*r->sizeofType : NULL;
 }
 
+void gensyn_ring_release(gensyn_ring_t * r, uint32_t count) {
+    #ifdef GENSYNDC_DEBUG
+        assert(count <= atomic_load(&r->write) - atomic_load(&r->read));
+    #endif
+    uint32_t read = atomic_load_explicit(&r->read, memory_order_relaxed);
+    atomic_store_explicit(&r->read, read + count, memory_order_release);
+}
 
 
+int gensyn_ring_pop_p(gensyn_ring_t * r, void * p) {
+    return gensyn_ring_pop_n(r, p, 1) == 1;
+}
+
+uint32_t gensyn_ring_pop_n(gensyn_ring_t * r, void * p, uint32_t count) {
+    uint8_t * dest = p;
+    uint32_t popped = 0;
+    uint32_t available;
+    const void * src;
+
+    while(popped < count && (src = gensyn_ring_peek(r, &available))) {
+        if (available > count - popped) available = count - popped;
+        memcpy(dest + popped*r->sizeofType, src, available*r->sizeofType);
+        popped += available;
+        gensyn_ring_release(r, available);
+    }
+    return popped;
+}
@@ -316,9 +316,11 @@ const gensyn_string_t * gensyn_string_chain_proceed(gensyn_string_t * t) {
 
 
 #define gensyn_string_temp_max_calls 128
-static gensyn_string_t * tempVals[gensyn_string_temp_max_calls];
-static int tempIter = 0;
-static int tempInit = 0;
+// each thread gets its own set of temporaries, since gates 
+// may be run from worker threads.
+static _Thread_local gensyn_string_t * tempVals[gensyn_string_temp_max_calls];
+static _Thread_local int tempIter = 0;
+static _Thread_local int tempInit = 0;
 
 const gensyn_string_t * gensyn_string_temporary_from_c_str(const char * s) {
     if (!tempInit) {
@@ -7,10 +7,20 @@
 #include <gensyn/gensyn.h>
 #include <gensyn/string.h>
 #include <gensyn/array.h>
+#include <gensyn/ring.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <alsa/asoundlib.h>
 #include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <semaphore.h>
 
 // Runs the give program with the given arguments.
 // standard out for that 
@@ -58,7 +68,7 @@ gensyn_system_t * gensyn_system_create() {
 
 
 
-// event queue
+// event queue. Events come out in the order they were pushed.
 typedef struct ev_queue_t ev_queue_t;
 
 // Creates a new event queue
@@ -67,7 +77,7 @@ static ev_queue_t * ev_queue_create();
 // Destroys an event queue
 static void ev_queue_destroy(ev_queue_t *);;
 
-// Pops an event from the queue
+// Pops the oldest event from the queue
 // If none left, object is empty
 static gensyn_system__input_event_t ev_queue_pop(ev_queue_t *);
 
@@ -81,6 +91,13 @@ static void ev_queue_push(ev_queue_t *, const gensyn_system__input_event_t *);
 
 
 
+// bytes read from a device per call.
+#define MIDI_READ_SIZE 256
+
+// seconds the device waits for the lookahead queue to fill 
+// before starting with whatever has been generated.
+#define LOOKAHEAD_FILL_TIMEOUT 2
+
 
 // independent input device, adstracted for both 
 // midi and evdev devices, since both event devices 
@@ -95,9 +112,6 @@ struct gensyn_linux_input_device_t{
     
     // always a string but the format depends on the type of device
     gensyn_string_t * devicePath;
-        
-    // queue to receive events from
-    ev_queue_t * events;
     
     // name identifier of the device
     gensyn_string_t * name;
@@ -105,9 +119,20 @@ struct gensyn_linux_input_device_t{
     // description of the device, if avail
     gensyn_string_t * desc;
     
-    // function that polls input for the device
-    void (*update)(gensyn_linux_input_device_t *, int);
+    // function that reads all pending input for the device
+    // into the input's event queue
+    void (*update)(gensyn_linux_input_t *, gensyn_linux_input_device_t *, int);
     
+    
+    // MIDI parser state, kept between reads since a message
+    // may be split across them.
+    // current (running) status, 0 if none
+    uint8_t status;
+    // data bytes received for the current message
+    uint8_t data[2];
+    uint8_t dataCount;
+    // whether within a system exclusive message
+    uint8_t inSysex;
 };
 
 
@@ -118,53 +143,180 @@ struct gensyn_linux_input_t {
     // of type gensyn_linux_input_t *
     gensyn_array_t * devices;
     
+    // pushed to by the input thread and send_event from any thread.
     ev_queue_t * events;
+    pthread_mutex_t eventsLock;
+    
+    // written to by gensyn_system_input_wake to end a wait early.
+    int wakePipe[2];
     
+    // of type struct pollfd. Rebuilt for each wait.
+    gensyn_array_t * pollFDs;
 };
 
 
 
 
 
+// Returns the number of data bytes that follow a status byte.
+static int gensyn_linux_midi__data_length(uint8_t status) {
+    if (status < 0xf0) {
+        switch(status & 0xf0) {
+          case 0xc0: // program change
+          case 0xd0: // channel pressure
+            return 1;
+          default:
+            return 2;
+        }
+    }
+    switch(status) {
+      case 0xf1: // time code quarter frame
+      case 0xf3: // song select
+        return 1;
+      case 0xf2: // song position
+        return 2;
+      default:
+        return 0;
+    }
+}
 
 
-
-static void gensyn_linux_input_device_update__midi(gensyn_linux_input_device_t * dev, int devId) {
-    int index = 0;
-    uint8_t code;
-    uint8_t status = 0;
-    gensyn_system__input_event_t ev = {0};
+static void gensyn_linux_midi__push(
+    gensyn_linux_input_t * input, 
+    int devId, 
+    uint64_t time,
+    uint8_t status, 
+    uint8_t data1, 
+    uint8_t data2
+) {
+    gensyn_system__input_event_t ev;
     ev.deviceID = devId;
-    
-    while(snd_rawmidi_read(dev->midi, &code, 1)) {
+    ev.input = status;
+    ev.inputData1 = data1;
+    ev.inputData2 = data2;
+    ev.time = time;
+    ev_queue_push(input->events, &ev);
+}
+
+
+// Turns raw bytes into events. Handles running status
+// (data bytes that reuse the last status byte), realtime 
+// bytes in the middle of a message and skips system exclusive 
+// messages. All events are stamped with the given time.
+static void gensyn_linux_midi__parse(
+    gensyn_linux_input_t * input, 
+    gensyn_linux_input_device_t * dev, 
+    int devId,
+    uint64_t time,
+    const uint8_t * bytes,
+    int count
+) {
+    int i;
+    for(i = 0; i < count; ++i) {
+        uint8_t code = bytes[i];
+        
+        // realtime: one byte, may appear anywhere
+        if (code >= 0xf8) {
+            gensyn_linux_midi__push(input, devId, time, code, 0, 0);
+            continue;
+        }
+        
         // status!
-        if (code & 0b10000000) {
-            status = code;
-            ev.input = status;
-        // data!
-        } else {
-            // since we always go to data 
-            if (index++%2==0) {
-                ev.inputData1 = code;
+        if (code & 0x80) {
+            dev->inSysex = code == 0xf0;
+            dev->status = 0;
+            dev->dataCount = 0;
+            if (code == 0xf0 || code == 0xf7) continue;
+            
+            if (gensyn_linux_midi__data_length(code)) {
+                dev->status = code;
             } else {
-                ev.inputData2 = code;
-                ev_queue_push(dev->events, &ev);
-                printf("new event: dev %d -> %d %d %d\n", 
-                    ev.deviceID,
-                    ev.input,
-                    ev.inputData1,
-                    ev.inputData2
-                );                        
+                gensyn_linux_midi__push(input, devId, time, code, 0, 0);
             }
+            continue;
+        }
+        
+        // data!
+        if (dev->inSysex || !dev->status) continue;
+        dev->data[dev->dataCount++] = code;
+        if (dev->dataCount == gensyn_linux_midi__data_length(dev->status)) {
+            gensyn_linux_midi__push(
+                input, 
+                devId, 
+                time,
+                dev->status, 
+                dev->data[0], 
+                dev->dataCount > 1 ? dev->data[1] : 0
+            );
+            dev->dataCount = 0;
+            
+            // only channel messages have running status
+            if (dev->status >= 0xf0) dev->status = 0;
         }
     }
 }
 
 
+
+static void gensyn_linux_input_device_update__midi(
+    gensyn_linux_input_t * input, 
+    gensyn_linux_input_device_t * dev, 
+    int devId
+) {
+    if (!dev->midi) return;
+    
+    uint8_t bytes[MIDI_READ_SIZE];
+    ssize_t count;
+    
+    // non-blocking, so this stops once the device has nothing left.
+    while((count = snd_rawmidi_read(dev->midi, bytes, MIDI_READ_SIZE)) > 0) {
+        // the input thread reads as soon as bytes arrive, so 
+        // the time of the read is the time of the events.
+        uint64_t time = gensyn_system_get_time();
+        pthread_mutex_lock(&input->eventsLock);
+        gensyn_linux_midi__parse(input, dev, devId, time, bytes, count);
+        pthread_mutex_unlock(&input->eventsLock);
+    }
+    
+    // likely unplugged. Closed so that waiting does not keep 
+    // returning for it; the next device query reopens it.
+    if (count < 0 && count != -EAGAIN && count != -EINTR) {
+        snd_rawmidi_close(dev->midi);
+        dev->midi = NULL;
+    }
+}
+
+
+// Opens the device at its current path.
+static void gensyn_linux_input_device_open__midi(gensyn_linux_input_device_t * dev) {
+    dev->status = 0;
+    dev->dataCount = 0;
+    dev->inSysex = 0;
+    if (snd_rawmidi_open(
+        &dev->midi, 
+        NULL,
+        gensyn_string_get_c_str(dev->devicePath),
+        SND_RAWMIDI_NONBLOCK
+    ) < 0) {
+        dev->midi = NULL;
+    }
+}
+
+
 gensyn_linux_input_t * gensyn_linux_input_create() {
     gensyn_linux_input_t * out = calloc(1, sizeof(gensyn_linux_input_t));
     out->events = ev_queue_create();
     out->devices = gensyn_array_create(sizeof(gensyn_linux_input_device_t*));
+    out->pollFDs = gensyn_array_create(sizeof(struct pollfd));
+    pthread_mutex_init(&out->eventsLock, NULL);
+    if (pipe(out->wakePipe) == 0) {
+        fcntl(out->wakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(out->wakePipe[1], F_SETFL, O_NONBLOCK);
+        fcntl(out->wakePipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(out->wakePipe[1], F_SETFD, FD_CLOEXEC);
+    } else {
+        out->wakePipe[0] = out->wakePipe[1] = -1;
+    }
     return out;
 }
 
@@ -260,17 +412,12 @@ int gensyn_system_input_query_devices(gensyn_system_t * g) {
                 gensyn_linux_input_device_t * dev = gensyn_array_at(g->input->devices, gensyn_linux_input_device_t*, i);
                 
                 
-                // the device has changed paths, likely from disconnecting and reconnecting.
-                // update the path so we dont lose the index
-                if (!gensyn_string_test_eq(dev->devicePath, midiPath)) {
-                    snd_rawmidi_close(dev->midi);
+                // the device has changed paths or was closed, likely from disconnecting 
+                // and reconnecting. update the path so we dont lose the index
+                if (!dev->midi || !gensyn_string_test_eq(dev->devicePath, midiPath)) {
+                    if (dev->midi) snd_rawmidi_close(dev->midi);
                     gensyn_string_set(dev->devicePath, midiPath);
-                    snd_rawmidi_open(
-                        &dev->midi, 
-                        NULL,
-                        gensyn_string_get_c_str(dev->devicePath),
-                        0
-                    );
+                    gensyn_linux_input_device_open__midi(dev);
                 }
                 
                 
@@ -285,14 +432,8 @@ int gensyn_system_input_query_devices(gensyn_system_t * g) {
             dev->name = gensyn_string_clone(midiName);
             dev->desc = gensyn_string_clone(midiName);
             dev->devicePath = gensyn_string_clone(midiPath);
-            dev->events = ev_queue_create();
             dev->update = gensyn_linux_input_device_update__midi;
-            snd_rawmidi_open(
-                &dev->midi, 
-                NULL,
-                gensyn_string_get_c_str(dev->devicePath),
-                0
-            );
+            gensyn_linux_input_device_open__midi(dev);
             gensyn_array_push(g->input->devices, dev);
         }
     }
@@ -308,22 +449,55 @@ int gensyn_system_input_query_devices(gensyn_system_t * g) {
 // midi events
 void gensyn_system_input_update(gensyn_system_t * g) {
     uint32_t i;
-    
-    // todo: separate into a polling func?
     for(i = 0; i < gensyn_array_get_size(g->input->devices); ++i) {
         gensyn_linux_input_device_t * dev = gensyn_array_at(g->input->devices, gensyn_linux_input_device_t*, i);
-        dev->update(dev, i);    
+        dev->update(g->input, dev, i);    
     }
+}
 
-    gensyn_system__input_event_t ev;    
+
+int gensyn_system_input_wait(gensyn_system_t * g, int timeoutMS) {
+    gensyn_array_t * fds = g->input->pollFDs;
+    gensyn_array_set_size(fds, 0);
+
+    struct pollfd wake;
+    wake.fd = g->input->wakePipe[0];
+    wake.events = POLLIN;
+    wake.revents = 0;
+    gensyn_array_push(fds, wake);
+
+    uint32_t i;
     for(i = 0; i < gensyn_array_get_size(g->input->devices); ++i) {
         gensyn_linux_input_device_t * dev = gensyn_array_at(g->input->devices, gensyn_linux_input_device_t*, i);
-        while(!ev_queue_empty(dev->events)) {
-            ev = ev_queue_pop(dev->events);
-            ev_queue_push(g->input->events, &ev);
-        }        
+        if (!dev->midi) continue;
+        
+        int count = snd_rawmidi_poll_descriptors_count(dev->midi);
+        if (count <= 0) continue;
+        uint32_t start = gensyn_array_get_size(fds);
+        gensyn_array_set_size(fds, start + count);
+        count = snd_rawmidi_poll_descriptors(dev->midi, &gensyn_array_at(fds, struct pollfd, start), count);
+        gensyn_array_set_size(fds, start + (count > 0 ? count : 0));
     }
     
+    int ready;
+    do {
+        ready = poll(gensyn_array_get_data(fds), gensyn_array_get_size(fds), timeoutMS);
+    } while(ready < 0 && errno == EINTR);
+    if (ready <= 0) return 0;
+    
+    // empty the pipe so the next wait blocks again
+    if (gensyn_array_at(fds, struct pollfd, 0).revents & POLLIN) {
+        uint8_t bytes[64];
+        while(read(g->input->wakePipe[0], bytes, sizeof(bytes)) > 0);
+    }
+    return 1;
+}
+
+
+void gensyn_system_input_wake(gensyn_system_t * g) {
+    uint8_t byte = 0;
+    // if the pipe is full, a wake is already pending.
+    if (write(g->input->wakePipe[1], &byte, 1)) {}
 }
 
 
@@ -336,17 +510,26 @@ int gensyn_system_input_get_events(gensyn_system_t * g,
 ) {
     *eventsReceived = 0;
     uint32_t i;
+    pthread_mutex_lock(&g->input->eventsLock);
     for(i = 0; i < eventsMax && !ev_queue_empty(g->input->events); ++i) {
         events[(*eventsReceived)++] = ev_queue_pop(g->input->events);
     }
-    return !ev_queue_empty(g->input->events);
+    int remaining = !ev_queue_empty(g->input->events);
+    pthread_mutex_unlock(&g->input->eventsLock);
+    return remaining;
 }
 
 
 // Sends an input event onto the queue.
 // Useful for simulating events externally
-void gensyn_system_input_send_event(gensyn_system_t * g, const gensyn_system__input_event_t * ev) {
-    ev_queue_push(g->input->events, ev);
+void gensyn_system_input_send_event(gensyn_system_t * g, const gensyn_system__input_event_t * evSrc) {
+    gensyn_system__input_event_t ev = *evSrc;
+    if (!ev.time) ev.time = gensyn_system_get_time();
+
+    pthread_mutex_lock(&g->input->eventsLock);
+    ev_queue_push(g->input->events, &ev);
+    pthread_mutex_unlock(&g->input->eventsLock);
+    gensyn_system_input_wake(g);
 }
 
 
@@ -359,6 +542,12 @@ void gensyn_system_usleep(uint32_t u) {
     usleep(u);
 }
 
+uint64_t gensyn_system_get_time() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
 
 static pthread_t threadPool[0xff] = {0};
 uint8_t threadPoolID = 0;
@@ -392,8 +581,36 @@ void gensyn_system_thread_cancel(gensyn_system_t * s, uint8_t id) {
 ////////////SOUND          ///////////////
 ////////////IMPLEMENTATION //////////////
 struct gensyn_linux_sound_t {
-    void (*fn)(void * userData, gensyn_sample_t *, uint32_t, float);
+    void (*fn)(void * userData, gensyn_sample_t **, uint32_t, uint32_t, float);
     void * userData;
+
+    gensyn_system_audio_options_t options;
+
+    // written by the audio thread once the device is set up.
+    // Only read from other threads once running is set.
+    gensyn_system_audio_info_t info;
+    atomic_int running;
+    atomic_uint_fast64_t xrunCount;
+
+    // With a lookahead, periods generated ahead by the render thread,
+    // each holding the samples of every channel one after the other.
+    // queueSpace counts the periods that may still be generated, so 
+    // the render thread stays at most lookahead periods ahead.
+    gensyn_ring_t * queue;
+    sem_t queueSpace;
+
+    // posted for each of the first lookahead periods generated, 
+    // which the device waits for before it starts.
+    sem_t queueFilled;
+    pthread_t renderThread;
+    atomic_int renderQuit;
+
+    // samples of the oldest queued period that have been played.
+    uint32_t queueOffset;
+
+    // silence, played when the render thread falls behind.
+    gensyn_sample_t * silence;
+    atomic_uint_fast64_t lateCount;
 };
 
 
@@ -402,58 +619,490 @@ gensyn_linux_sound_t * gensyn_linux_sound_create() {
 }
 
 
+void gensyn_system_audio_options_init(gensyn_system_audio_options_t * options) {
+    options->device = "default";
+    options->sampleRate = 44100;
+    options->channels = 1;
+    options->periodSize = 256;
+    options->periodCount = 2;
+    options->format = GENSYN_SYSTEM__AUDIO_FORMAT__FLOAT32;
+    options->realtimePriority = 0;
+    options->lockMemory = 0;
+    options->mmap = 0;
+    options->lookahead = 0;
+}
+
+
+static snd_pcm_format_t gensyn_alsa__format(gensyn_system__audio_format_e format) {
+    switch(format) {
+      case GENSYN_SYSTEM__AUDIO_FORMAT__PCM16: return SND_PCM_FORMAT_S16_LE;
+      case GENSYN_SYSTEM__AUDIO_FORMAT__PCM32: return SND_PCM_FORMAT_S32_LE;
+      default:                                 return SND_PCM_FORMAT_FLOAT_LE;
+    }
+}
+
+static uint32_t gensyn_alsa__format_size(gensyn_system__audio_format_e format) {
+    return format == GENSYN_SYSTEM__AUDIO_FORMAT__PCM16 ? 2 : 4;
+}
+
+
+
+// Negotiates the hardware and software parameters with the device.
+// What was set up is written to info. Returns 0 and prints why
+// if the device cannot be used.
+static int gensyn_alsa__configure(
+    snd_pcm_t * handle,
+    const gensyn_system_audio_options_t * options,
+    gensyn_system_audio_info_t * info
+) {
+    snd_pcm_hw_params_t * hw;
+    snd_pcm_sw_params_t * sw;
+    int err;
+    snd_pcm_hw_params_malloc(&hw);
+    snd_pcm_hw_params_any(handle, hw);
+
+    info->mmap = options->mmap && snd_pcm_hw_params_set_access(handle, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0;
+    if (!info->mmap && (err = snd_pcm_hw_params_set_access(handle, hw, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+        printf("Audio device does not support interleaved access: %s\n", snd_strerror(err));
+        goto L_FAIL;
+    }
+
+    // the asked-for format first, then the others from best to worst
+    gensyn_system__audio_format_e formats[] = {
+        options->format,
+        GENSYN_SYSTEM__AUDIO_FORMAT__FLOAT32,
+        GENSYN_SYSTEM__AUDIO_FORMAT__PCM32,
+        GENSYN_SYSTEM__AUDIO_FORMAT__PCM16
+    };
+    uint32_t i;
+    for(i = 0; i < sizeof(formats)/sizeof(formats[0]); ++i) {
+        if ((err = snd_pcm_hw_params_set_format(handle, hw, gensyn_alsa__format(formats[i]))) >= 0) break;
+    }
+    if (err < 0) {
+        printf("Audio device supports none of the sample formats: %s\n", snd_strerror(err));
+        goto L_FAIL;
+    }
+    info->format = formats[i];
+
+    if ((err = snd_pcm_hw_params_set_channels(handle, hw, options->channels)) < 0) {
+        printf("Audio device does not support %d channels: %s\n", (int)options->channels, snd_strerror(err));
+        goto L_FAIL;
+    }
+
+    unsigned int rate = options->sampleRate;
+    unsigned int periods = options->periodCount;
+    snd_pcm_uframes_t period = options->periodSize;
+    snd_pcm_uframes_t bufferSize;
+    if ((err = snd_pcm_hw_params_set_rate_near(handle, hw, &rate, NULL)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(handle, hw, &period, NULL)) < 0 ||
+        (err = snd_pcm_hw_params_set_periods_near(handle, hw, &periods, NULL)) < 0 ||
+        (err = snd_pcm_hw_params(handle, hw)) < 0) {
+        printf("Audio device cannot be set up: %s\n", snd_strerror(err));
+        goto L_FAIL;
+    }
+    snd_pcm_hw_params_get_period_size(hw, &period, NULL);
+    snd_pcm_hw_params_get_periods(hw, &periods, NULL);
+    snd_pcm_hw_params_get_buffer_size(hw, &bufferSize);
+    snd_pcm_hw_params_free(hw);
+
+    info->sampleRate = rate;
+    info->channels = options->channels;
+    info->periodSize = period;
+    info->periodCount = periods;
+    info->bufferSize = bufferSize;
+    info->latency = bufferSize / (double)rate;
+
+
+    // start once the buffer is full, and wake 
+    // whenever a whole period can be written.
+    snd_pcm_sw_params_malloc(&sw);
+    snd_pcm_sw_params_current(handle, sw);
+    snd_pcm_sw_params_set_start_threshold(handle, sw, bufferSize);
+    snd_pcm_sw_params_set_avail_min(handle, sw, period);
+    err = snd_pcm_sw_params(handle, sw);
+    snd_pcm_sw_params_free(sw);
+    if (err < 0) {
+        printf("Audio device cannot be set up: %s\n", snd_strerror(err));
+        return 0;
+    }
+    return 1;
+
+  L_FAIL:
+    snd_pcm_hw_params_free(hw);
+    return 0;
+}
+
+
+// Interleaves the separate buffer of each channel into 
+// samples of the device's format.
+static void gensyn_alsa__interleave(
+    gensyn_sample_t ** in, 
+    void * out, 
+    uint32_t count, 
+    uint32_t channels,
+    gensyn_system__audio_format_e format
+) {
+    uint32_t i, c;
+    for(c = 0; c < channels; ++c) {
+        const gensyn_sample_t * plane = in[c];
+        switch(format) {
+          case GENSYN_SYSTEM__AUDIO_FORMAT__PCM16: {
+            int16_t * o = (int16_t *)out + c;
+            for(i = 0; i < count; ++i) {
+                float v = plane[i];
+                if (v > 1.f) v = 1.f; else if (v < -1.f) v = -1.f;
+                o[i*channels] = v * 32767.f;
+            }
+            break;
+          }
+          case GENSYN_SYSTEM__AUDIO_FORMAT__PCM32: {
+            int32_t * o = (int32_t *)out + c;
+            for(i = 0; i < count; ++i) {
+                double v = plane[i];
+                if (v > 1.0) v = 1.0; else if (v < -1.0) v = -1.0;
+                o[i*channels] = v * 2147483647.0;
+            }
+            break;
+          }
+          default: {
+            float * o = (float *)out + c;
+            if (channels == 1) {
+                memcpy(o, plane, count*sizeof(float));
+                break;
+            }
+            for(i = 0; i < count; ++i) {
+                o[i*channels] = plane[i];
+            }
+            break;
+          }
+        }
+    }
+}
+
+
+// Gives the calling thread SCHED_FIFO at the given priority.
+// Returns 0 if not permitted.
+static int gensyn_alsa__set_realtime(int priority) {
+    struct sched_param param = {0};
+    int min = sched_get_priority_min(SCHED_FIFO);
+    int max = sched_get_priority_max(SCHED_FIFO);
+    if (priority < min) priority = min;
+    if (priority > max) priority = max;
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+
+// Restarts the stream after an xrun or a suspend. Anything 
+// else cannot be recovered from, in which case 0 is returned.
+static int gensyn_alsa__recover(gensyn_linux_sound_t * sound, snd_pcm_t * handle, int err) {
+    if (err == -EPIPE) {
+        atomic_fetch_add(&sound->xrunCount, 1);
+    }
+    if ((err = snd_pcm_recover(handle, err, 1)) < 0) {
+        printf("Audio stream stopped: %s\n", snd_strerror(err));
+        return 0;
+    }
+    return 1;
+}
+
+
+// Runs ahead of the audio thread, generating periods into the queue 
+// whenever there is space.
+static void * gensyn_alsa__render_main(void * src) {
+    gensyn_linux_sound_t * sound = src;
+    gensyn_system_audio_info_t * info = &sound->info;
+    uint32_t period = info->periodSize;
+    gensyn_sample_t * channels[info->channels];
+    uint32_t available, i;
+    uint32_t filling = info->lookahead;
+
+    // below the audio thread, which must never wait on this one.
+    if (sound->options.realtimePriority) {
+        gensyn_alsa__set_realtime(sound->options.realtimePriority > 1 ? sound->options.realtimePriority-1 : 1);
+    }
+
+    while(1) {
+        sem_wait(&sound->queueSpace);
+        if (atomic_load(&sound->renderQuit)) break;
+
+        // there is always room for each count of queueSpace.
+        gensyn_sample_t * block = gensyn_ring_reserve(sound->queue, 1, &available);
+        for(i = 0; i < info->channels; ++i) {
+            channels[i] = block + (size_t)i*period;
+        }
+        sound->fn(
+            sound->userData,
+            channels,
+            info->channels,
+            period,
+            info->sampleRate
+        );
+        gensyn_ring_commit(sound->queue, 1);
+        if (filling) {
+            --filling;
+            sem_post(&sound->queueFilled);
+        }
+    }
+    return NULL;
+}
+
+
+// Points planes at the next count samples of each channel. Without 
+// a lookahead, they are generated into the given channel buffers. 
+// With one, they are taken from the queue, so count must not go past 
+// the end of a queued period; if the render thread has fallen behind,
+// silence is given instead. Once the samples have been used, 
+// gensyn_alsa__used must be called.
+static void gensyn_alsa__generate(
+    gensyn_linux_sound_t * sound,
+    gensyn_sample_t ** planes,
+    gensyn_sample_t ** channels,
+    uint32_t count
+) {
+    gensyn_system_audio_info_t * info = &sound->info;
+    uint32_t available, i;
+    if (!sound->queue) {
+        for(i = 0; i < info->channels; ++i) planes[i] = channels[i];
+        sound->fn(sound->userData, planes, info->channels, count, info->sampleRate);
+        return;
+    }
+
+    gensyn_sample_t * block = (gensyn_sample_t *)gensyn_ring_peek(sound->queue, &available);
+    if (!block) {
+        atomic_fetch_add(&sound->lateCount, 1);
+        for(i = 0; i < info->channels; ++i) planes[i] = sound->silence;
+        return;
+    }
+    for(i = 0; i < info->channels; ++i) {
+        planes[i] = block + (size_t)i*info->periodSize + sound->queueOffset;
+    }
+    sound->queueOffset += count;
+}
+
+// Gives a queued period back to the render thread once all of it is played.
+static void gensyn_alsa__used(gensyn_linux_sound_t * sound) {
+    if (sound->queue && sound->queueOffset == sound->info.periodSize) {
+        sound->queueOffset = 0;
+        gensyn_ring_release(sound->queue, 1);
+        sem_post(&sound->queueSpace);
+    }
+}
+
+
+// Generates a period and copies it to the device.
+// Returns 0 if the stream has stopped.
+static int gensyn_alsa__write_period(
+    gensyn_linux_sound_t * sound, 
+    snd_pcm_t * handle, 
+    gensyn_sample_t ** channels,
+    uint8_t * frames
+) {
+    gensyn_system_audio_info_t * info = &sound->info;
+    uint32_t period = info->periodSize;
+    uint32_t frameSize = info->channels * gensyn_alsa__format_size(info->format);
+
+    gensyn_sample_t * planes[info->channels];
+    gensyn_alsa__generate(sound, planes, channels, period);
+    gensyn_alsa__interleave(planes, frames, period, info->channels, info->format);
+    gensyn_alsa__used(sound);
+
+    // a write may be cut short by a signal or an xrun, 
+    // in which case the rest is written after recovering.
+    uint32_t written = 0;
+    while(written < period) {
+        snd_pcm_sframes_t count = snd_pcm_writei(
+            handle, frames + written*frameSize, period - written
+        );
+        if (count >= 0) {
+            written += count;
+        } else if (!gensyn_alsa__recover(sound, handle, count)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Generates a period straight into the device's buffer. Mono float 
+// samples need no conversion, so the output gate writes them in place; 
+// anything else, including samples from the lookahead queue, is 
+// interleaved into it. The buffer is a whole number of periods, 
+// so a period only comes in parts after an xrun.
+// Returns 0 if the stream has stopped.
+static int gensyn_alsa__write_period_mmap(
+    gensyn_linux_sound_t * sound, 
+    snd_pcm_t * handle, 
+    gensyn_sample_t ** channels
+) {
+    gensyn_system_audio_info_t * info = &sound->info;
+    uint32_t period = info->periodSize;
+    uint32_t done = 0;
+    gensyn_sample_t * planes[info->channels];
+    int err;
+    while(done < period) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+        if (avail < 0) {
+            if (!gensyn_alsa__recover(sound, handle, avail)) return 0;
+            continue;
+        }
+        if (avail < period - done) {
+            // unlike writes, commits never start the stream, so it is 
+            // started here once the buffer is full, also after a recover.
+            if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED) {
+                if ((err = snd_pcm_start(handle)) < 0 && !gensyn_alsa__recover(sound, handle, err)) return 0;
+                continue;
+            }
+            if ((err = snd_pcm_wait(handle, -1)) < 0 && !gensyn_alsa__recover(sound, handle, err)) return 0;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t * areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t count = period - done;
+        if (sound->queue && count > period - sound->queueOffset) {
+            count = period - sound->queueOffset;
+        }
+        if ((err = snd_pcm_mmap_begin(handle, &areas, &offset, &count)) < 0) {
+            if (!gensyn_alsa__recover(sound, handle, err)) return 0;
+            continue;
+        }
+        uint8_t * out = (uint8_t *)areas[0].addr + areas[0].first/8 + offset*(areas[0].step/8);
+
+        if (!sound->queue && info->format == GENSYN_SYSTEM__AUDIO_FORMAT__FLOAT32 && areas[0].step == 8*sizeof(gensyn_sample_t)) {
+            gensyn_sample_t * direct = (gensyn_sample_t *)out;
+            sound->fn(sound->userData, &direct, 1, count, info->sampleRate);
+        } else {
+            gensyn_alsa__generate(sound, planes, channels, count);
+            gensyn_alsa__interleave(planes, out, count, info->channels, info->format);
+            gensyn_alsa__used(sound);
+        }
+        done += count;
+
+        // a short commit means the device ran out while generating.
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, count);
+        if (committed < 0 || committed != count) {
+            if (!gensyn_alsa__recover(sound, handle, committed < 0 ? committed : -EPIPE)) return 0;
+        }
+    }
+    return 1;
+}
+
+
 static void * gensyn_alsa_thread_main(void * src) {
     gensyn_system_t * s = src;
+    gensyn_linux_sound_t * sound = s->sound;
+    gensyn_system_audio_info_t * info = &sound->info;
     snd_pcm_t * handle;
-    assert(snd_pcm_open(
+    int err;
+
+    if ((err = snd_pcm_open(
         &handle,
-        "default",
+        sound->options.device,
         SND_PCM_STREAM_PLAYBACK,
         0
-    )>=0);
+    )) < 0) {
+        printf("Cannot open audio device %s: %s\n", sound->options.device, snd_strerror(err));
+        return NULL;
+    }
     
     // set blocking so we can natural use flow control
     snd_pcm_nonblock(handle, 0);
     
-    assert(snd_pcm_set_params(
-        handle,
-        SND_PCM_FORMAT_FLOAT_LE,
-        SND_PCM_ACCESS_RW_INTERLEAVED,
-        1,
-        44100,
-        1,
-        20000
-    )>=0);
-    
-    int sampleCount = 256;
-    float buffer[256];
-    
-    while(1) {
-        s->sound->fn(
-            s->sound->userData,
-            buffer,
-            256,
-            44100
-        );
-        snd_pcm_writei(
-            handle, buffer, 256
-        );
-        
+    if (!gensyn_alsa__configure(handle, &sound->options, info)) {
+        snd_pcm_close(handle);
+        return NULL;
     }
+
     
+    // everything the loop needs is allocated up front, 
+    // so that it never waits on the allocator.
+    uint32_t frameSize = info->channels * gensyn_alsa__format_size(info->format);
+    gensyn_sample_t * samples = calloc((size_t)info->periodSize*info->channels, sizeof(gensyn_sample_t));
+    gensyn_sample_t ** channels = malloc(info->channels*sizeof(gensyn_sample_t *));
+    uint32_t i;
+    for(i = 0; i < info->channels; ++i) {
+        channels[i] = samples + (size_t)i*info->periodSize;
+    }
+    uint8_t * frames = info->mmap ? NULL : calloc(info->periodSize, frameSize);
+
+    if (sound->options.lockMemory) {
+        info->memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    }
+    if (sound->options.realtimePriority) {
+        info->realtime = gensyn_alsa__set_realtime(sound->options.realtimePriority);
+    }
+
+    info->lookahead = sound->options.lookahead;
+    if (info->lookahead) {
+        info->latency += info->lookahead * info->periodSize / (double)info->sampleRate;
+        sound->queue = gensyn_ring_create(info->periodSize*info->channels*sizeof(gensyn_sample_t), info->lookahead);
+        sound->silence = calloc(info->periodSize, sizeof(gensyn_sample_t));
+        sem_init(&sound->queueSpace, 0, info->lookahead);
+        sem_init(&sound->queueFilled, 0, 0);
+        pthread_create(&sound->renderThread, NULL, gensyn_alsa__render_main, sound);
+
+        // the device starts with a full queue. If the render thread 
+        // stalls, it starts anyway and plays silence until it catches up.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += LOOKAHEAD_FILL_TIMEOUT;
+        for(i = 0; i < info->lookahead;) {
+            if (!sem_timedwait(&sound->queueFilled, &deadline)) {
+                ++i;
+            } else if (errno != EINTR) {
+                break;
+            }
+        }
+    }
+    info->running = 1;
+    atomic_store(&sound->running, 1);
+
     
-    
+    while(info->mmap ? 
+        gensyn_alsa__write_period_mmap(sound, handle, channels) 
+    :
+        gensyn_alsa__write_period(sound, handle, channels, frames)
+    );
+
+    atomic_store(&sound->running, 0);
+    if (sound->queue) {
+        atomic_store(&sound->renderQuit, 1);
+        sem_post(&sound->queueSpace);
+        pthread_join(sound->renderThread, NULL);
+        sem_destroy(&sound->queueSpace);
+        sem_destroy(&sound->queueFilled);
+        gensyn_ring_destroy(sound->queue);
+        free(sound->silence);
+        sound->queue = NULL;
+    }
+    snd_pcm_close(handle);
+    free(samples);
+    free(channels);
+    free(frames);
+    return NULL;
 }
 
 
 void gensyn_system_setup_audio(
     gensyn_system_t * s,
-    void (*fn)(void * userData, gensyn_sample_t * samples, uint32_t numSamples, float sampleRate),
+    const gensyn_system_audio_options_t * options,
+    void (*fn)(void * userData, gensyn_sample_t ** channels, uint32_t channelCount, uint32_t numSamples, float sampleRate),
     void * userData
 ) {
     if (!s->sound->fn) {
         s->sound->fn = fn;
         s->sound->userData = userData;
+        if (options) {
+            s->sound->options = *options;
+        } else {
+            gensyn_system_audio_options_init(&s->sound->options);
+        }
+        if (!s->sound->options.device)      s->sound->options.device = "default";
+        if (!s->sound->options.sampleRate)  s->sound->options.sampleRate = 44100;
+        if (!s->sound->options.channels)    s->sound->options.channels = 1;
+        if (!s->sound->options.periodSize)  s->sound->options.periodSize = 256;
+        if (!s->sound->options.periodCount) s->sound->options.periodCount = 2;
         
         gensyn_system_thread_create(
             s,
@@ -464,6 +1113,16 @@ void gensyn_system_setup_audio(
 }
 
 
+int gensyn_system_get_audio_info(gensyn_system_t * s, gensyn_system_audio_info_t * info) {
+    memset(info, 0, sizeof(gensyn_system_audio_info_t));
+    if (!atomic_load(&s->sound->running)) return 0;
+    *info = s->sound->info;
+    info->xrunCount = atomic_load(&s->sound->xrunCount);
+    info->lateCount = atomic_load(&s->sound->lateCount);
+    return 1;
+}
+
+
 
 
 
@@ -481,9 +1140,12 @@ void gensyn_system_setup_audio(
 
 ///////// utility implementation 
 
+// circular: count events starting at head, wrapping 
+// around the end of the allocation.
 struct ev_queue_t {
     uint32_t allocSize;
-    uint32_t ptr;
+    uint32_t head;
+    uint32_t count;
     gensyn_system__input_event_t * q;
     
 };
@@ -493,6 +1155,7 @@ static ev_queue_t * ev_queue_create() {
     ev_queue_t * out = calloc(1, sizeof(ev_queue_t));
     out->allocSize = 256;
     out->q = malloc(sizeof(gensyn_system__input_event_t)*out->allocSize);
+    return out;
 }
 
 // Destroys an event queue
@@ -501,28 +1164,36 @@ static void ev_queue_destroy(ev_queue_t * q) {
     free(q);
 }
 
-// Pops an event from the queue
+// Pops the oldest event from the queue
 // If none left, object is empty
 static gensyn_system__input_event_t ev_queue_pop(ev_queue_t * q) {
-    if (q->ptr == 0) {
+    if (q->count == 0) {
         gensyn_system__input_event_t out = {0};
         return out;
     }
-    return q->q[q->ptr--];
+    gensyn_system__input_event_t out = q->q[q->head];
+    q->head = (q->head + 1) % q->allocSize;
+    q->count--;
+    return out;
 }
 
 // Returns whether the event queue is empty
 static int ev_queue_empty(const ev_queue_t * q) {
-    return q->ptr == 0;
+    return q->count == 0;
 }
 
 // Pushes an evetn to the queue
 static void ev_queue_push(ev_queue_t * q, const gensyn_system__input_event_t * ev) {
-    if (q->ptr + 1 >= q->allocSize) {
-        q->allocSize = 1.4*q->allocSize;
+    if (q->count == q->allocSize) {
+        uint32_t oldSize = q->allocSize;
+        q->allocSize *= 2;
         q->q = realloc(q->q, q->allocSize*sizeof(gensyn_system__input_event_t));
+        
+        // unwrap the part that was at the start so the events stay in order
+        memcpy(q->q + oldSize, q->q, q->head*sizeof(gensyn_system__input_event_t));
     }
-    q->q[q->ptr++] = *ev;
+    q->q[(q->head + q->count) % q->allocSize] = *ev;
+    q->count++;
 }
 
 
@@ -532,7 +1203,6 @@ static void ev_queue_push(ev_queue_t * q, const gensyn_system__input_event_t * e
 
 
 
-
 gensyn_string_t * exec_capture_output(const gensyn_string_t * prog, const gensyn_string_t * args) {
     gensyn_string_t * str = gensyn_string_create();
     gensyn_string_concat(str, prog);
@@ -550,6 +550,7 @@ void gensyn_table_iter_start(gensyn_table_iter_t * t, gensyn_table_t * src) {
     t->src = src;
     t->currentBucketID = 0;
     t->current = src->buckets[0];
+    t->isEnd = 0;
 
     
     if (!t->current)
@@ -0,0 +1,399 @@
+#include <gensyn/vector.h>
+
+#include <math.h>
+#include <threads.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTOR_X86
+#include <immintrin.h>
+#endif
+
+
+
+typedef struct {
+    void  (*fill)       (gensyn_sample_t *, float, uint32_t);
+    void  (*scale)      (gensyn_sample_t *, const gensyn_sample_t *, float, uint32_t);
+    void  (*clamp)      (gensyn_sample_t *, const gensyn_sample_t *, float, float, uint32_t);
+    void  (*mix)        (gensyn_sample_t *, const gensyn_sample_t *, uint32_t);
+    void  (*multiply)   (gensyn_sample_t *, const gensyn_sample_t *, uint32_t);
+    void  (*multiplyAdd)(gensyn_sample_t *, const gensyn_sample_t *, const gensyn_sample_t *, uint32_t);
+    float (*peak)       (const gensyn_sample_t *, uint32_t);
+    void  (*sumScaled)  (gensyn_sample_t *, const gensyn_sample_t * const *, const float *, uint32_t, uint32_t);
+} gensyn_vector__kernels_t;
+
+
+
+
+/////// scalar
+
+static void fill__scalar(gensyn_sample_t * out, float value, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) out[i] = value;
+}
+
+static void scale__scalar(gensyn_sample_t * out, const gensyn_sample_t * in, float scale, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) out[i] = in[i] * scale;
+}
+
+static void clamp__scalar(gensyn_sample_t * out, const gensyn_sample_t * in, float low, float high, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        float v = in[i];
+        if (v > high) v = high;
+        if (v < low)  v = low;
+        out[i] = v;
+    }
+}
+
+static void mix__scalar(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) out[i] += in[i];
+}
+
+static void multiply__scalar(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) out[i] *= in[i];
+}
+
+static void multiply_add__scalar(gensyn_sample_t * out, const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count) {
+    uint32_t i;
+    for(i = 0; i < count; ++i) out[i] += a[i] * b[i];
+}
+
+static float peak__scalar(const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i;
+    float peak = 0;
+    for(i = 0; i < count; ++i) {
+        if (fabsf(in[i]) > peak) peak = fabsf(in[i]);
+    }
+    return peak;
+}
+
+
+static void sum_scaled__scalar(gensyn_sample_t * out, const gensyn_sample_t * const * ins, const float * gains, uint32_t n, uint32_t count) {
+    uint32_t i, k;
+    for(i = 0; i < count; ++i) {
+        float v = 0;
+        for(k = 0; k < n; ++k) v += ins[k][i] * gains[k];
+        out[i] = v;
+    }
+}
+
+
+static const gensyn_vector__kernels_t kernels__scalar = {
+    fill__scalar,
+    scale__scalar,
+    clamp__scalar,
+    mix__scalar,
+    multiply__scalar,
+    multiply_add__scalar,
+    peak__scalar,
+    sum_scaled__scalar
+};
+
+
+
+
+
+#ifdef VECTOR_X86
+
+/////// SSE2
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static void fill__sse2(gensyn_sample_t * out, float value, uint32_t count) {
+    uint32_t i = 0;
+    __m128 v = _mm_set1_ps(value);
+    for(; i + 4 <= count; i += 4) _mm_storeu_ps(out+i, v);
+    fill__scalar(out+i, value, count-i);
+}
+
+SSE2 static void scale__sse2(gensyn_sample_t * out, const gensyn_sample_t * in, float scale, uint32_t count) {
+    uint32_t i = 0;
+    __m128 s = _mm_set1_ps(scale);
+    for(; i + 4 <= count; i += 4) _mm_storeu_ps(out+i, _mm_mul_ps(_mm_loadu_ps(in+i), s));
+    scale__scalar(out+i, in+i, scale, count-i);
+}
+
+SSE2 static void clamp__sse2(gensyn_sample_t * out, const gensyn_sample_t * in, float low, float high, uint32_t count) {
+    uint32_t i = 0;
+    __m128 lo = _mm_set1_ps(low);
+    __m128 hi = _mm_set1_ps(high);
+    // min and max give their second operand when either is NaN, 
+    // so the bounds go first to pass NaN through like the scalar clamp.
+    for(; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out+i, _mm_max_ps(lo, _mm_min_ps(hi, _mm_loadu_ps(in+i))));
+    }
+    clamp__scalar(out+i, in+i, low, high, count-i);
+}
+
+SSE2 static void mix__sse2(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out+i, _mm_add_ps(_mm_loadu_ps(out+i), _mm_loadu_ps(in+i)));
+    }
+    mix__scalar(out+i, in+i, count-i);
+}
+
+SSE2 static void multiply__sse2(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(out+i, _mm_mul_ps(_mm_loadu_ps(out+i), _mm_loadu_ps(in+i)));
+    }
+    multiply__scalar(out+i, in+i, count-i);
+}
+
+SSE2 static void multiply_add__sse2(gensyn_sample_t * out, const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 p = _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+        _mm_storeu_ps(out+i, _mm_add_ps(_mm_loadu_ps(out+i), p));
+    }
+    multiply_add__scalar(out+i, a+i, b+i, count-i);
+}
+
+SSE2 static float peak__sse2(const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 m = _mm_setzero_ps();
+    // the sample goes first so that a NaN is skipped, like the scalar peak.
+    for(; i + 4 <= count; i += 4) {
+        m = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(in+i), mask), m);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float peak = peak__scalar(in+i, count-i);
+    for(i = 0; i < 4; ++i) {
+        if (lanes[i] > peak) peak = lanes[i];
+    }
+    return peak;
+}
+
+
+SSE2 static void sum_scaled__sse2(gensyn_sample_t * out, const gensyn_sample_t * const * ins, const float * gains, uint32_t n, uint32_t count) {
+    uint32_t i = 0, k;
+    for(; i + 4 <= count; i += 4) {
+        __m128 v = _mm_setzero_ps();
+        for(k = 0; k < n; ++k) {
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(ins[k]+i), _mm_set1_ps(gains[k])));
+        }
+        _mm_storeu_ps(out+i, v);
+    }
+    for(; i < count; ++i) {
+        float v = 0;
+        for(k = 0; k < n; ++k) v += ins[k][i] * gains[k];
+        out[i] = v;
+    }
+}
+
+
+static const gensyn_vector__kernels_t kernels__sse2 = {
+    fill__sse2,
+    scale__sse2,
+    clamp__sse2,
+    mix__sse2,
+    multiply__sse2,
+    multiply_add__sse2,
+    peak__sse2,
+    sum_scaled__sse2
+};
+
+
+
+
+
+/////// AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void fill__avx2(gensyn_sample_t * out, float value, uint32_t count) {
+    uint32_t i = 0;
+    __m256 v = _mm256_set1_ps(value);
+    for(; i + 8 <= count; i += 8) _mm256_storeu_ps(out+i, v);
+    fill__scalar(out+i, value, count-i);
+}
+
+AVX2 static void scale__avx2(gensyn_sample_t * out, const gensyn_sample_t * in, float scale, uint32_t count) {
+    uint32_t i = 0;
+    __m256 s = _mm256_set1_ps(scale);
+    for(; i + 8 <= count; i += 8) _mm256_storeu_ps(out+i, _mm256_mul_ps(_mm256_loadu_ps(in+i), s));
+    scale__scalar(out+i, in+i, scale, count-i);
+}
+
+AVX2 static void clamp__avx2(gensyn_sample_t * out, const gensyn_sample_t * in, float low, float high, uint32_t count) {
+    uint32_t i = 0;
+    __m256 lo = _mm256_set1_ps(low);
+    __m256 hi = _mm256_set1_ps(high);
+    for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out+i, _mm256_max_ps(lo, _mm256_min_ps(hi, _mm256_loadu_ps(in+i))));
+    }
+    clamp__scalar(out+i, in+i, low, high, count-i);
+}
+
+AVX2 static void mix__avx2(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out+i, _mm256_add_ps(_mm256_loadu_ps(out+i), _mm256_loadu_ps(in+i)));
+    }
+    mix__scalar(out+i, in+i, count-i);
+}
+
+AVX2 static void multiply__avx2(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out+i, _mm256_mul_ps(_mm256_loadu_ps(out+i), _mm256_loadu_ps(in+i)));
+    }
+    multiply__scalar(out+i, in+i, count-i);
+}
+
+// no FMA here; a fused multiply-add rounds differently than the other sets.
+AVX2 static void multiply_add__avx2(gensyn_sample_t * out, const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count) {
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 p = _mm256_mul_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i));
+        _mm256_storeu_ps(out+i, _mm256_add_ps(_mm256_loadu_ps(out+i), p));
+    }
+    multiply_add__scalar(out+i, a+i, b+i, count-i);
+}
+
+AVX2 static float peak__avx2(const gensyn_sample_t * in, uint32_t count) {
+    uint32_t i = 0;
+    __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 m = _mm256_setzero_ps();
+    for(; i + 8 <= count; i += 8) {
+        m = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(in+i), mask), m);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float peak = peak__scalar(in+i, count-i);
+    for(i = 0; i < 8; ++i) {
+        if (lanes[i] > peak) peak = lanes[i];
+    }
+    return peak;
+}
+
+
+AVX2 static void sum_scaled__avx2(gensyn_sample_t * out, const gensyn_sample_t * const * ins, const float * gains, uint32_t n, uint32_t count) {
+    uint32_t i = 0, k;
+    for(; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_setzero_ps();
+        for(k = 0; k < n; ++k) {
+            v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(ins[k]+i), _mm256_set1_ps(gains[k])));
+        }
+        _mm256_storeu_ps(out+i, v);
+    }
+    for(; i < count; ++i) {
+        float v = 0;
+        for(k = 0; k < n; ++k) v += ins[k][i] * gains[k];
+        out[i] = v;
+    }
+}
+
+
+static const gensyn_vector__kernels_t kernels__avx2 = {
+    fill__avx2,
+    scale__avx2,
+    clamp__avx2,
+    mix__avx2,
+    multiply__avx2,
+    multiply_add__avx2,
+    peak__avx2,
+    sum_scaled__avx2
+};
+
+#endif
+
+
+
+
+
+
+static const gensyn_vector__kernels_t * kernels = &kernels__scalar;
+static gensyn_vector__isa_e isa = GENSYN_VECTOR__ISA__SCALAR;
+static once_flag initOnce = ONCE_FLAG_INIT;
+
+
+static void gensyn_vector__init() {
+    if (!gensyn_vector_set_isa(GENSYN_VECTOR__ISA__AVX2)) {
+        gensyn_vector_set_isa(GENSYN_VECTOR__ISA__SSE2);
+    }
+}
+
+void gensyn_vector_init() {
+    call_once(&initOnce, gensyn_vector__init);
+}
+
+
+int gensyn_vector_set_isa(gensyn_vector__isa_e which) {
+    switch(which) {
+      case GENSYN_VECTOR__ISA__SCALAR:
+        kernels = &kernels__scalar;
+        break;
+
+      #ifdef VECTOR_X86
+      case GENSYN_VECTOR__ISA__SSE2:
+        if (!__builtin_cpu_supports("sse2")) return 0;
+        kernels = &kernels__sse2;
+        break;
+
+      case GENSYN_VECTOR__ISA__AVX2:
+        if (!__builtin_cpu_supports("avx2")) return 0;
+        kernels = &kernels__avx2;
+        break;
+      #endif
+
+      default:
+        return 0;
+    }
+    isa = which;
+    return 1;
+}
+
+gensyn_vector__isa_e gensyn_vector_get_isa() {
+    return isa;
+}
+
+const char * gensyn_vector_get_isa_name(gensyn_vector__isa_e which) {
+    switch(which) {
+      case GENSYN_VECTOR__ISA__SCALAR: return "scalar";
+      case GENSYN_VECTOR__ISA__SSE2:   return "SSE2";
+      case GENSYN_VECTOR__ISA__AVX2:   return "AVX2";
+    }
+    return "";
+}
+
+
+
+
+void gensyn_vector_fill(gensyn_sample_t * out, float value, uint32_t count) {
+    kernels->fill(out, value, count);
+}
+
+void gensyn_vector_scale(gensyn_sample_t * out, const gensyn_sample_t * in, float scale, uint32_t count) {
+    kernels->scale(out, in, scale, count);
+}
+
+void gensyn_vector_clamp(gensyn_sample_t * out, const gensyn_sample_t * in, float low, float high, uint32_t count) {
+    kernels->clamp(out, in, low, high, count);
+}
+
+void gensyn_vector_mix(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    kernels->mix(out, in, count);
+}
+
+void gensyn_vector_multiply(gensyn_sample_t * out, const gensyn_sample_t * in, uint32_t count) {
+    kernels->multiply(out, in, count);
+}
+
+void gensyn_vector_multiply_add(gensyn_sample_t * out, const gensyn_sample_t * a, const gensyn_sample_t * b, uint32_t count) {
+    kernels->multiplyAdd(out, a, b, count);
+}
+
+float gensyn_vector_peak(const gensyn_sample_t * in, uint32_t count) {
+    return kernels->peak(in, count);
+}
+
+void gensyn_vector_sum_scaled(gensyn_sample_t * out, const gensyn_sample_t * const * ins, const float * gains, uint32_t n, uint32_t count) {
+    kernels->sumScaled(out, ins, gains, n, count);
+}
@@ -0,0 +1,341 @@
+#include <gensyn/voices.h>
+#include <gensyn/gensyn.h>
+#include <gensyn/vector.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Most note events given to one voice in one block.
+// Any more are dropped.
+#define VOICE_MAX_EVENTS 32
+
+// A released voice stops once the peak of
+// its output for a block is below this.
+#define VOICE_SILENCE 0.0001f
+
+
+
+typedef enum {
+    // not playing and not run.
+    GENSYN_VOICES__STATE__IDLE,
+
+    // playing a note that is still held.
+    GENSYN_VOICES__STATE__HELD,
+
+    // playing a note that has been released.
+    GENSYN_VOICES__STATE__RELEASED,
+} gensyn_voices__state_e;
+
+
+typedef struct {
+    gensyn_voices__state_e state;
+
+    // the note being played and its channel, from 1 to 16.
+    int note;
+    int channel;
+
+    // when the note started, in notes given out.
+    // Lower is older.
+    uint64_t age;
+
+    // samples run since the note was released.
+    uint64_t releasedFor;
+
+    // peak of the output during the last block.
+    float peak;
+
+    // this voice's copy of the template output.
+    gensyn_gate_t * output;
+    gensyn_gate_plan_t * plan;
+
+    // of type gensyn_gate_t *. All the gates cloned for this voice.
+    gensyn_array_t * gates;
+
+    // note events for the current block.
+    gensyn_gate_event_t events[VOICE_MAX_EVENTS];
+    uint32_t eventCount;
+} gensyn_voices__voice_t;
+
+
+struct gensyn_voices_t {
+    gensyn_voices__voice_t * voices;
+    uint32_t count;
+    uint32_t activeCount;
+
+    // source of ages for new notes
+    uint64_t ageCounter;
+
+    gensyn_voices__steal_e steal;
+    int channel;
+    float release;
+
+    // output of a single voice.
+    gensyn_sample_t * scratch;
+    uint32_t scratchSize;
+};
+
+
+
+
+// Clones the gate and everything connected to its INs into the voice.
+// The voice's gates are parallel to sources, which holds the template
+// gates that have already been cloned, so each is only cloned once.
+static gensyn_gate_t * gensyn_voices__clone(
+    gensyn_t * ctx,
+    gensyn_voices__voice_t * voice,
+    gensyn_array_t * sources,
+    gensyn_gate_t * src
+) {
+    uint32_t i;
+    for(i = 0; i < gensyn_array_get_size(sources); ++i) {
+        if (gensyn_array_at(sources, gensyn_gate_t *, i) == src) {
+            return gensyn_array_at(voice->gates, gensyn_gate_t *, i);
+        }
+    }
+
+    gensyn_gate_t * clone = gensyn_gate_create(ctx, gensyn_gate_get_class(src));
+    gensyn_array_push(sources, src);
+    gensyn_array_push(voice->gates, clone);
+
+    gensyn_gate_copy_parameters(clone, src);
+
+    const gensyn_array_t * ins = gensyn_gate_get_in_names(src);
+    uint32_t len = gensyn_array_get_size(ins);
+    for(i = 0; i < len; ++i) {
+        const gensyn_string_t * name = gensyn_array_at(ins, gensyn_string_t *, i);
+        gensyn_gate_t * in = gensyn_gate_get_in_connection(src, name);
+        if (in) {
+            gensyn_gate_connect(gensyn_voices__clone(ctx, voice, sources, in), name, clone);
+        }
+    }
+    return clone;
+}
+
+
+
+gensyn_voices_t * gensyn_voices_create(
+    gensyn_t * ctx,
+    gensyn_gate_t * templateOutput,
+    uint32_t voiceCount
+) {
+    if (!templateOutput || !voiceCount) return NULL;
+
+    gensyn_voices_t * v = calloc(1, sizeof(gensyn_voices_t));
+    v->voices = calloc(voiceCount, sizeof(gensyn_voices__voice_t));
+    v->count = voiceCount;
+    v->steal = GENSYN_VOICES__STEAL__OLDEST;
+    v->release = 1;
+
+    gensyn_array_t * sources = gensyn_array_create(sizeof(gensyn_gate_t *));
+    uint32_t i;
+    for(i = 0; i < voiceCount; ++i) {
+        gensyn_voices__voice_t * voice = v->voices+i;
+        voice->gates = gensyn_array_create(sizeof(gensyn_gate_t *));
+        voice->plan = gensyn_gate_plan_create();
+
+        gensyn_array_clear(sources);
+        voice->output = gensyn_voices__clone(ctx, voice, sources, templateOutput);
+
+        // the clones are not shared with anything yet, so the
+        // plans can be compiled here rather than while running.
+        gensyn_gate_plan_compile(voice->plan, voice->output);
+    }
+    gensyn_array_destroy(sources);
+
+    v->scratch = malloc(GENSYN_GATE_PLAN_MAX_SAMPLES*sizeof(gensyn_sample_t));
+    v->scratchSize = GENSYN_GATE_PLAN_MAX_SAMPLES;
+    return v;
+}
+
+
+void gensyn_voices_destroy(gensyn_voices_t * v) {
+    uint32_t i, n;
+    for(i = 0; i < v->count; ++i) {
+        gensyn_voices__voice_t * voice = v->voices+i;
+        gensyn_gate_plan_destroy(voice->plan);
+
+        // destroying a gate disconnects it from the rest,
+        // so they can go in any order.
+        for(n = 0; n < gensyn_array_get_size(voice->gates); ++n) {
+            gensyn_gate_destroy(gensyn_array_at(voice->gates, gensyn_gate_t *, n));
+        }
+        gensyn_array_destroy(voice->gates);
+    }
+    free(v->voices);
+    free(v->scratch);
+    free(v);
+}
+
+
+uint32_t gensyn_voices_get_count(const gensyn_voices_t * v) {
+    return v->count;
+}
+
+uint32_t gensyn_voices_get_active_count(const gensyn_voices_t * v) {
+    return v->activeCount;
+}
+
+void gensyn_voices_set_steal(gensyn_voices_t * v, gensyn_voices__steal_e steal) {
+    v->steal = steal;
+}
+
+void gensyn_voices_set_channel(gensyn_voices_t * v, int channel) {
+    v->channel = channel;
+}
+
+void gensyn_voices_set_release(gensyn_voices_t * v, float seconds) {
+    v->release = seconds;
+}
+
+
+
+
+static void gensyn_voices__give_event(gensyn_voices__voice_t * voice, const gensyn_gate_event_t * event) {
+    if (voice->eventCount < VOICE_MAX_EVENTS) {
+        voice->events[voice->eventCount++] = *event;
+    }
+}
+
+
+// Picks a voice for a new note. Returns NULL if the note is dropped.
+static gensyn_voices__voice_t * gensyn_voices__pick(gensyn_voices_t * v, int note, int channel) {
+    gensyn_voices__voice_t * idle = NULL;
+    gensyn_voices__voice_t * released = NULL;
+    gensyn_voices__voice_t * held = NULL;
+    uint32_t i;
+    for(i = 0; i < v->count; ++i) {
+        gensyn_voices__voice_t * voice = v->voices+i;
+        switch(voice->state) {
+          case GENSYN_VOICES__STATE__IDLE:
+            if (!idle) idle = voice;
+            break;
+
+          case GENSYN_VOICES__STATE__RELEASED:
+          case GENSYN_VOICES__STATE__HELD:
+            // the same note played again keeps its voice
+            if (voice->note == note && voice->channel == channel) {
+                return voice;
+            }
+            if (voice->state == GENSYN_VOICES__STATE__RELEASED) {
+                if (!released || voice->age < released->age) released = voice;
+                break;
+            }
+
+            if (!held) {
+                held = voice;
+            } else if (v->steal == GENSYN_VOICES__STEAL__QUIETEST) {
+                if (voice->peak < held->peak) held = voice;
+            } else if (voice->age < held->age) {
+                held = voice;
+            }
+            break;
+        }
+    }
+
+    if (idle)     return idle;
+    if (released) return released;
+    if (v->steal == GENSYN_VOICES__STEAL__NONE) return NULL;
+    return held;
+}
+
+
+// Gives the event to the voice playing the note, if any.
+static void gensyn_voices__note_off(gensyn_voices_t * v, int note, int channel, const gensyn_gate_event_t * event) {
+    uint32_t i;
+    for(i = 0; i < v->count; ++i) {
+        gensyn_voices__voice_t * voice = v->voices+i;
+        if (voice->state == GENSYN_VOICES__STATE__HELD && voice->note == note && voice->channel == channel) {
+            voice->state = GENSYN_VOICES__STATE__RELEASED;
+            voice->releasedFor = 0;
+            gensyn_voices__give_event(voice, event);
+            return;
+        }
+    }
+}
+
+
+// Sorts the block's note events into the voices.
+static void gensyn_voices__allocate(gensyn_voices_t * v, const gensyn_gate_event_t * events, uint32_t eventCount) {
+    uint32_t i, n;
+    for(i = 0; i < eventCount; ++i) {
+        const gensyn_system__input_event_t * ev = &events[i].event;
+        if (ev->input > 0xff) continue;
+
+        int type = ev->input & 0xf0;
+        int channel = (ev->input & 0x0f) + 1;
+        if (v->channel && channel != v->channel) continue;
+
+        // all notes off and all sound off
+        if (type == 0xb0 && (ev->inputData1 == 123 || ev->inputData1 == 120)) {
+            for(n = 0; n < v->count; ++n) {
+                gensyn_voices__voice_t * voice = v->voices+n;
+                if (voice->state == GENSYN_VOICES__STATE__HELD && voice->channel == channel) {
+                    gensyn_voices__note_off(v, voice->note, channel, events+i);
+                }
+            }
+            continue;
+        }
+
+        if (type == 0x90 && ev->inputData2) {
+            gensyn_voices__voice_t * voice = gensyn_voices__pick(v, ev->inputData1, channel);
+            if (!voice) continue;
+            voice->state = GENSYN_VOICES__STATE__HELD;
+            voice->note = ev->inputData1;
+            voice->channel = channel;
+            voice->age = v->ageCounter++;
+            voice->releasedFor = 0;
+            gensyn_voices__give_event(voice, events+i);
+
+        } else if (type == 0x80 || type == 0x90) {
+            gensyn_voices__note_off(v, ev->inputData1, channel, events+i);
+        }
+    }
+}
+
+
+
+void gensyn_voices_run(
+    gensyn_voices_t * v,
+    const gensyn_gate_event_t * events,
+    uint32_t eventCount,
+    gensyn_sample_t * buffer,
+    uint32_t sampleCount,
+    float sampleRate
+) {
+    uint32_t i;
+
+    // only when run outside of a plan, which never gives more.
+    if (v->scratchSize < sampleCount) {
+        free(v->scratch);
+        v->scratch = malloc(sampleCount*sizeof(gensyn_sample_t));
+        v->scratchSize = sampleCount;
+    }
+
+    for(i = 0; i < v->count; ++i) {
+        v->voices[i].eventCount = 0;
+    }
+    gensyn_voices__allocate(v, events, eventCount);
+
+
+    // the first voice playing writes to buffer directly, 
+    // and the rest are added in from the scratch buffer.
+    v->activeCount = 0;
+    for(i = 0; i < v->count; ++i) {
+        gensyn_voices__voice_t * voice = v->voices+i;
+        if (voice->state == GENSYN_VOICES__STATE__IDLE) continue;
+
+        gensyn_sample_t * out = v->activeCount ? v->scratch : buffer;
+        gensyn_gate_plan_set_events(voice->plan, voice->events, voice->eventCount);
+        gensyn_gate_plan_run(voice->plan, out, sampleCount, sampleRate);
+        voice->peak = gensyn_vector_peak(out, sampleCount);
+        if (v->activeCount) gensyn_vector_mix(buffer, out, sampleCount);
+        v->activeCount++;
+
+        if (voice->state == GENSYN_VOICES__STATE__RELEASED) {
+            voice->releasedFor += sampleCount;
+            if (voice->peak < VOICE_SILENCE || voice->releasedFor >= v->release * sampleRate) {
+                voice->state = GENSYN_VOICES__STATE__IDLE;
+            }
+        }
+    }
+}